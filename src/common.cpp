@@ -1,3 +1,14 @@
+#include <bit>
+#include <cstring>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "common.hpp"
 
 /////////////////////////////////////
@@ -124,14 +135,12 @@ std::vector<std::vector<int64_t>> split_int_columns(std::istream& stream)
 
 std::vector<std::vector<int64_t>> split_int_columns(const std::string& str)
 {
-    std::stringstream stream(str);
-    return split_int_columns(stream);
+    return split_view_int_columns(str);
 }
 
 std::vector<std::vector<int64_t>> split_int_columns(const char *str)
 {
-    std::stringstream stream(str);
-    return split_int_columns(stream);
+    return split_view_int_columns(str);
 }
 
 std::vector<std::vector<int64_t>> split_int_lines(std::istream& stream)
@@ -183,3 +192,158 @@ std::vector<std::vector<std::string>> split_line_blocks(const std::string& str)
     return split_line_blocks(stream);
 }
 
+
+/////////////////////////////////////
+// Character class scanning
+
+uint64_t byte_mask(const char *block, size_t n, std::string_view chars)
+{
+    CHECK(n <= 64);
+    uint64_t mask = 0;
+    size_t k = 0;
+#ifdef __SSE2__
+    for (; k + 16 <= n; k += 16) {
+	__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + k));
+	__m128i eq = _mm_setzero_si128();
+	for (char c : chars) {
+	    eq = _mm_or_si128(eq, _mm_cmpeq_epi8(bytes, _mm_set1_epi8(c)));
+	}
+	uint64_t bits = static_cast<uint32_t>(_mm_movemask_epi8(eq));
+	mask |= bits << k;
+    }
+#endif
+    for (; k < n; k++) {
+	if (chars.find(block[k]) != std::string_view::npos) {
+	    mask |= 1ull << k;
+	}
+    }
+    return mask;
+}
+
+std::vector<size_t> find_all_of(std::string_view str, std::string_view chars)
+{
+    std::vector<size_t> offsets;
+    for (size_t base = 0; base < str.size(); base += 64) {
+	size_t n = std::min<size_t>(64, str.size() - base);
+	uint64_t mask = byte_mask(str.data() + base, n, chars);
+	while (mask != 0) {
+	    offsets.push_back(base + static_cast<size_t>(std::countr_zero(mask)));
+	    mask &= mask - 1;
+	}
+    }
+    return offsets;
+}
+
+std::vector<std::pair<size_t, size_t>> find_cells(std::string_view str,
+						  std::string_view chars,
+						  bool invert)
+{
+    CHECK(chars.find('\n') == std::string_view::npos);
+
+    std::vector<std::pair<size_t, size_t>> cells;
+    size_t row = 0;
+    size_t row_start = 0;
+    for (size_t base = 0; base < str.size(); base += 64) {
+	size_t n = std::min<size_t>(64, str.size() - base);
+	uint64_t valid = n == 64 ? ~0ull : (1ull << n) - 1;
+	uint64_t newlines = byte_mask(str.data() + base, n, "\n");
+	uint64_t matches = byte_mask(str.data() + base, n, chars);
+	if (invert) {
+	    matches = ~matches & ~newlines & valid;
+	}
+	// Visit both in order, so that each newline bumps the row of the
+	// matches after it
+	uint64_t events = matches | newlines;
+	while (events != 0) {
+	    size_t k = static_cast<size_t>(std::countr_zero(events));
+	    uint64_t bit = 1ull << k;
+	    if (newlines & bit) {
+		row++;
+		row_start = base + k + 1;
+	    } else {
+		cells.emplace_back(row, base + k - row_start);
+	    }
+	    events &= events - 1;
+	}
+    }
+    return cells;
+}
+
+/////////////////////////////////////
+// CPU affinity
+
+std::vector<int> parse_cpu_list(const std::string& str)
+{
+    std::vector<int> cpus;
+    for (const std::string& field : split_at(str, ',')) {
+	std::vector<std::string> range = split_at(field, '-');
+	CHECK(range.size() == 1 || range.size() == 2);
+	int first = std::stoi(range.front());
+	int last = std::stoi(range.back());
+	CHECK(first >= 0 && first <= last);
+	for (int cpu = first; cpu <= last; cpu++)
+	    cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+const std::vector<int>& pinned_cpus()
+{
+    static const std::vector<int> cpus = []() {
+	const char *env = std::getenv("AOC_CPUS");
+	return env ? parse_cpu_list(env) : std::vector<int>();
+    }();
+    return cpus;
+}
+
+bool pin_thread(size_t slot)
+{
+    const std::vector<int>& cpus = pinned_cpus();
+    if (cpus.empty())
+	return false;
+#ifdef __linux__
+    int cpu = cpus[slot % cpus.size()];
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(static_cast<size_t>(cpu), &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+	throw std::runtime_error("Unable to pin thread to cpu " + std::to_string(cpu)
+				 + ": " + std::strerror(errno));
+    }
+    return true;
+#else
+    throw std::runtime_error("AOC_CPUS is only supported on Linux");
+#endif
+}
+
+std::optional<int> current_cpu()
+{
+#ifdef __linux__
+    int cpu = sched_getcpu();
+    if (cpu >= 0)
+	return cpu;
+#endif
+    return {};
+}
+
+/////////////////////////////////////
+// Worker threads
+
+size_t worker_count()
+{
+    static const size_t n = []() {
+	const char *env = std::getenv("AOC_THREADS");
+	if (env) {
+	    int64_t x = parse_int(env);
+	    CHECK(x > 0);
+	    return static_cast<size_t>(x);
+	}
+	return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }();
+    return n;
+}
+
+size_t worker_count(size_t bytes)
+{
+    return std::clamp<size_t>(bytes >> 20, 1, worker_count());
+}
@@ -1,13 +1,18 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 #include <cstdlib>
 #include <exception>
 #include <fstream>
 #include <format>
 #include <iostream>
+#include <limits>
 #include <optional>
 #include <sstream>
+#include <string_view>
+#include <thread>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -40,9 +45,209 @@ std::vector<std::vector<int64_t>> split_int_lines(const char *str);
 std::vector<std::vector<std::string>> split_line_blocks(std::istream& stream);
 std::vector<std::vector<std::string>> split_line_blocks(const std::string& stream);
 
+// Bit k of the result is set if block[k] is one of chars, for k < n <= 64
+uint64_t byte_mask(const char *block, size_t n, std::string_view chars);
+
+// Offsets of all the bytes of str that are one of chars
+std::vector<size_t> find_all_of(std::string_view str, std::string_view chars);
+
+// (row, column) of all the bytes of str that are (or, if invert, are
+// not) one of chars, counting rows with the newlines
+std::vector<std::pair<size_t, size_t>> find_cells(std::string_view str,
+						  std::string_view chars,
+						  bool invert = false);
+
 #define CHECK(cond) do { if (!(cond)) { throw std::runtime_error(std::format("Assertion error in file {} at line {}: {}", __FILE__, __LINE__, #cond)); } } while (0)
 
 
+/////////////////////////////////////
+// CPU affinity
+//
+// Setting AOC_CPUS (e.g. "2", "2,3" or "4-7") pins the runner thread to
+// the first listed CPU and worker thread k to the next ones, round
+// robin, so that timings don't move around with thread migrations.
+
+// The CPUs listed in AOC_CPUS, empty if unset
+const std::vector<int>& pinned_cpus();
+
+// Pin the calling thread to its CPU: slot 0 is the runner thread and
+// slot k + 1 is worker thread k. Returns false if AOC_CPUS is unset.
+bool pin_thread(size_t slot);
+
+// The CPU the calling thread runs on, if known
+std::optional<int> current_cpu();
+
+/////////////////////////////////////
+// Worker threads
+//
+// The parallel modes use AOC_THREADS workers (e.g. "4"), or one per
+// hardware thread if unset.
+
+size_t worker_count();
+
+// For an input of `bytes` bytes: a thread per MB or so, up to worker_count()
+size_t worker_count(size_t bytes);
+
+// Run f(k) on worker thread k for k < n, pinned with pin_thread(k + 1),
+// and rethrow the first exception once they are all done
+template <typename F>
+void run_workers(size_t n, F f)
+{
+    std::vector<std::exception_ptr> errors(n);
+    std::vector<std::thread> threads;
+    for (size_t k = 0; k < n; k++) {
+	threads.emplace_back([&f, &errors, k]() {
+	    try {
+		pin_thread(k + 1);
+		f(k);
+	    } catch (...) {
+		errors[k] = std::current_exception();
+	    }
+	});
+    }
+    for (std::thread& t : threads)
+	t.join();
+    for (const std::exception_ptr& e : errors) {
+	if (e)
+	    std::rethrow_exception(e);
+    }
+}
+
+/////////////////////////////////////
+// Constexpr string handling
+//
+// These work on std::string_view and only allocate transiently, so
+// the parsers built on them can run at compile time on the embedded
+// examples (see the static_tests() in each day).
+
+constexpr std::vector<std::string_view>
+split_view_at(std::string_view str, char c, bool allow_empty = false)
+{
+    std::vector<std::string_view> parts;
+    size_t begin = 0;
+    while (begin < str.size()) {
+	size_t end = str.find(c, begin);
+	if (end == std::string_view::npos)
+	    end = str.size();
+	if (allow_empty || end > begin)
+	    parts.push_back(str.substr(begin, end - begin));
+	begin = end + 1;
+    }
+    return parts;
+}
+
+constexpr std::vector<std::string_view> split_view_lines(std::string_view str)
+{
+    return split_view_at(str, '\n', true);
+}
+
+// At most n consecutive pieces of str, each but the last ending with a
+// newline, of about the same size
+constexpr std::vector<std::string_view> split_view_chunks(std::string_view str, size_t n)
+{
+    CHECK(n > 0);
+    std::vector<std::string_view> chunks;
+    size_t begin = 0;
+    for (size_t k = 1; k <= n && begin < str.size(); k++) {
+	size_t end = str.size();
+	if (k < n) {
+	    end = str.find('\n', std::max(begin, str.size() / n * k));
+	    end = (end == std::string_view::npos) ? str.size() : end + 1;
+	}
+	chunks.push_back(str.substr(begin, end - begin));
+	begin = end;
+    }
+    return chunks;
+}
+
+// x followed by the digit c, which has to fit in int64_t
+constexpr int64_t push_digit(int64_t x, char c)
+{
+    CHECK(x <= (std::numeric_limits<int64_t>::max() - (c - '0')) / 10);
+    return x * 10 + (c - '0');
+}
+
+constexpr int64_t parse_int(std::string_view str)
+{
+    bool negative = !str.empty() && str.front() == '-';
+    if (negative)
+	str.remove_prefix(1);
+    CHECK(!str.empty());
+    int64_t x = 0;
+    for (char c : str) {
+	CHECK(c >= '0' && c <= '9');
+	x = push_digit(x, c);
+    }
+    return negative ? -x : x;
+}
+
+constexpr std::vector<int64_t> split_view_ints(std::string_view str, char c = ' ')
+{
+    std::vector<int64_t> nums;
+    for (std::string_view s : split_view_at(str, c))
+	nums.push_back(parse_int(s));
+    return nums;
+}
+
+// Single pass over the input: each number is parsed straight into its
+// column, and the columns are reserved from the length of the first
+// row. Tabs and carriage returns count as spaces and blank lines are
+// skipped.
+constexpr std::vector<std::vector<int64_t>> split_view_int_columns(std::string_view str)
+{
+    std::vector<std::vector<int64_t>> columns;
+    bool first_row = true;
+    size_t col = 0;
+    int64_t x = 0;
+    bool in_num = false;
+    bool negative = false;
+    for (size_t i = 0; i <= str.size(); i++) {
+	char c = (i < str.size()) ? str[i] : '\n';
+	if (c >= '0' && c <= '9') {
+	    x = push_digit(x, c);
+	    in_num = true;
+	    continue;
+	}
+	if (c == '-' && !in_num && !negative) {
+	    negative = true;
+	    continue;
+	}
+	CHECK(in_num || !negative);
+	if (in_num) {
+	    if (first_row && col == columns.size())
+		columns.emplace_back();
+	    CHECK(col < columns.size());
+	    columns[col++].push_back(negative ? -x : x);
+	    x = 0;
+	    in_num = false;
+	    negative = false;
+	}
+	if (c == '\n') {
+	    if (col == 0)
+		continue;
+	    if (first_row) {
+		for (std::vector<int64_t>& column : columns)
+		    column.reserve(str.size() / (i + 1) + 1);
+		first_row = false;
+	    }
+	    CHECK(col == columns.size());
+	    col = 0;
+	} else {
+	    CHECK(c == ' ' || c == '\t' || c == '\r');
+	}
+    }
+    return columns;
+}
+
+constexpr std::vector<std::vector<int64_t>> split_view_int_lines(std::string_view str)
+{
+    std::vector<std::vector<int64_t>> int_lines;
+    for (std::string_view line : split_view_lines(str))
+	int_lines.push_back(split_view_ints(line));
+    return int_lines;
+}
+
+
 class NotImplemented : std::exception {};
 
 template <int N>
@@ -72,6 +277,14 @@ struct DayBase  {
 	return read_to_string("inputs/day" + std::to_string(N) + ".txt");
     }
 
+    // With pinned threads, report where the part ran
+    void print_cpu() {
+	std::optional<int> cpu = current_cpu();
+	if (!pinned_cpus().empty() && cpu) {
+	    std::cout << "[cpu " << *cpu << "] ";
+	}
+    }
+
     void verify_print(Answer answer, int part) {
 	std::cout << answer << std::flush;
 
@@ -95,7 +308,27 @@ struct DayBase  {
 	}
     }
     
+    // Wall-clock seconds of each of `reps` runs of a part, after an
+    // untimed warm-up run
+    std::vector<double> time_part(const std::string& input, int part, size_t reps) {
+	std::vector<double> secs;
+	for (size_t r = 0; r <= reps; r++) {
+	    auto start = std::chrono::steady_clock::now();
+	    if (part == 1)
+		part_1(input);
+	    else
+		part_2(input);
+	    auto stop = std::chrono::steady_clock::now();
+	    if (r > 0)
+		secs.push_back(std::chrono::duration<double>(stop - start).count());
+	}
+	return secs;
+    }
+
     int run(std::optional<int> part) {
+#ifdef RUNTIME_TESTS
+	// The constexpr-capable checks are static_asserts; only the
+	// remaining ones run here, and only in a RUNTIME_TESTS build.
 	std::cout << "Day " << N << ", Tests  // " << std::flush;
 	try {
 	    tests();
@@ -103,6 +336,7 @@ struct DayBase  {
 	} catch(NotImplemented&) {
 	    std::cout << "Not Implemented" << std::endl;
 	}
+#endif
 
 	std::string input = load_input();
 
@@ -110,6 +344,7 @@ struct DayBase  {
 	    std::cout << "Day " << N << ", Part 1 // " << std::flush;
 	    try {
 		Answer ans_1 = part_1(input);
+		print_cpu();
 		verify_print(ans_1, 1);
 	    } catch(NotImplemented&) {
 		std::cout << "Not Implemented" << std::endl;
@@ -120,6 +355,7 @@ struct DayBase  {
 	    std::cout << "Day " << N << ", Part 2 // " << std::flush;
 	    try {
 		Answer ans_2 = part_2(input);
+		print_cpu();
 		verify_print(ans_2, 2);
 	    } catch(NotImplemented&) {
 		std::cout << "Not Implemented" << std::endl;
@@ -210,7 +446,7 @@ size_t Grid<T>::idx(size_t i, size_t j) const
 {
     CHECK(i < nrows);
     CHECK(j < ncols);
-    return i * nrows + j;
+    return i * ncols + j;
 }
 
 template <typename T>
@@ -236,3 +472,90 @@ T& Grid<T>::ref(size_t i, size_t j)
 {
     return m_buf.at(idx(i, j));
 }
+
+
+// Structure-of-arrays mode for Grid: Grid<SoA<Ts...>> keeps one
+// contiguous array per field instead of one array of records, and
+// recomputes the position of a cell from its index. A pass that only
+// reads one field then only streams through that field's bytes.
+template <typename... Ts>
+struct SoA {};
+
+template <typename... Ts>
+struct Grid<SoA<Ts...>> {
+    template <typename F>
+    Grid(const std::string& input, F f);
+    size_t nrows{0};
+    size_t ncols{0};
+    size_t size() const { return nrows * ncols; }
+    size_t idx(size_t i, size_t j) const;
+    size_t row(size_t k) const { return k / ncols; }
+    size_t col(size_t k) const { return k % ncols; }
+    template <size_t K> const auto& at(size_t k) const;
+    template <size_t K> const auto& at(size_t i, size_t j) const;
+    template <size_t K> auto& ref(size_t k);
+    template <size_t K> auto& ref(size_t i, size_t j);
+    template <size_t K> auto& field() { return std::get<K>(m_bufs); }
+    template <size_t K> const auto& field() const { return std::get<K>(m_bufs); }
+    std::tuple<std::vector<Ts>...> m_bufs{};
+};
+
+template <typename... Ts>
+template <typename F>
+Grid<SoA<Ts...>>::Grid(const std::string& input, F f)
+{
+    std::vector<std::string> lines = split_lines(input);
+
+    if (lines.empty())
+	return;
+
+    nrows = lines.size();
+    ncols = lines.front().size();
+    std::apply([&](auto&... bufs) { (bufs.reserve(size()), ...); }, m_bufs);
+
+    for (size_t i = 0; i < nrows; i++) {
+	CHECK(lines.at(i).size() == ncols);
+	for (size_t j = 0; j < ncols; j++) {
+	    std::tuple<Ts...> fields = f(i, j, lines.at(i).at(j));
+	    [&]<size_t... K>(std::index_sequence<K...>) {
+		(std::get<K>(m_bufs).push_back(std::move(std::get<K>(fields))), ...);
+	    }(std::index_sequence_for<Ts...>{});
+	}
+    }
+}
+
+template <typename... Ts>
+size_t Grid<SoA<Ts...>>::idx(size_t i, size_t j) const
+{
+    CHECK(i < nrows);
+    CHECK(j < ncols);
+    return i * ncols + j;
+}
+
+template <typename... Ts>
+template <size_t K>
+const auto& Grid<SoA<Ts...>>::at(size_t k) const
+{
+    return field<K>().at(k);
+}
+
+template <typename... Ts>
+template <size_t K>
+const auto& Grid<SoA<Ts...>>::at(size_t i, size_t j) const
+{
+    return at<K>(idx(i, j));
+}
+
+template <typename... Ts>
+template <size_t K>
+auto& Grid<SoA<Ts...>>::ref(size_t k)
+{
+    return field<K>().at(k);
+}
+
+template <typename... Ts>
+template <size_t K>
+auto& Grid<SoA<Ts...>>::ref(size_t i, size_t j)
+{
+    return ref<K>(idx(i, j));
+}
@@ -1,4 +1,11 @@
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <numbers>
 #include <numeric>
+#include <queue>
 #include <unordered_map>
 
 #include "common.hpp"
@@ -24,59 +31,686 @@ compute_similarities(const std::vector<int64_t>& nums,
     return scores;
 }
 
-std::vector<int64_t> compute_distances(const std::vector<int64_t>& lhs,
-				       const std::vector<int64_t>& rhs)
+constexpr std::vector<int64_t> compute_distances(const std::vector<int64_t>& lhs,
+						 const std::vector<int64_t>& rhs)
 {
     CHECK(lhs.size() == rhs.size());
     std::vector<int64_t> dists;
     for (size_t i = 0; i < lhs.size(); i++)
-	dists.push_back(std::abs(lhs[i] - rhs[i]));
+	dists.push_back(lhs[i] > rhs[i] ? lhs[i] - rhs[i] : rhs[i] - lhs[i]);
     return dists;
 }
 
+// Same as summing compute_distances, without the temporary vector. The
+// loop is branchless so that it vectorizes where the target has 64-bit
+// vector compares.
+constexpr int64_t sum_distances(const std::vector<int64_t>& lhs,
+				const std::vector<int64_t>& rhs)
+{
+    CHECK(lhs.size() == rhs.size());
+    int64_t sum = 0;
+    for (size_t i = 0; i < lhs.size(); i++) {
+	int64_t d = lhs[i] - rhs[i];
+	sum += (d < 0) ? -d : d;
+    }
+    return sum;
+}
+
+// LSD radix sort, one byte per pass and only as many passes as the
+// largest value needs. The location IDs are small and non-negative;
+// anything else goes through std::sort.
+constexpr void radix_sort(std::vector<int64_t>& nums)
+{
+    if (nums.empty())
+	return;
+
+    auto [min, max] = std::minmax_element(nums.begin(), nums.end());
+    if (*min < 0) {
+	std::sort(nums.begin(), nums.end());
+	return;
+    }
+
+    uint64_t bound = static_cast<uint64_t>(*max);
+    std::vector<int64_t> buf(nums.size());
+    for (uint64_t shift = 0; shift < 64 && (bound >> shift) != 0; shift += 8) {
+	auto digit = [=](int64_t x) { return (static_cast<uint64_t>(x) >> shift) & 0xff; };
+	std::array<size_t, 257> offsets{};
+	for (int64_t x : nums)
+	    offsets[digit(x) + 1]++;
+	std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+	for (int64_t x : nums)
+	    buf[offsets[digit(x)]++] = x;
+	nums.swap(buf);
+    }
+}
+
+constexpr Answer total_distance(std::string_view input)
+{
+    std::vector<std::vector<int64_t>> columns = split_view_int_columns(input);
+    CHECK(columns.size() == 2);
+    radix_sort(columns[0]);
+    radix_sort(columns[1]);
+    return sum_distances(columns[0], columns[1]);
+}
+
 Answer part_1(const std::string& input)
 {
-    std::vector<std::vector<int64_t>> columns = split_int_columns(input);
+    return total_distance(input);
+}
+
+// Similarity score by walking both sorted columns together
+constexpr int64_t similarity_merge(std::vector<int64_t>& lhs, std::vector<int64_t>& rhs)
+{
+    radix_sort(lhs);
+    radix_sort(rhs);
+
+    int64_t score = 0;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < lhs.size() && j < rhs.size()) {
+	int64_t x = lhs[i];
+	int64_t n_lhs = 0;
+	for (; i < lhs.size() && lhs[i] == x; i++)
+	    n_lhs++;
+	for (; j < rhs.size() && rhs[j] < x; j++)
+	    ;
+	int64_t n_rhs = 0;
+	for (; j < rhs.size() && rhs[j] == x; j++)
+	    n_rhs++;
+	score += x * n_lhs * n_rhs;
+    }
+    return score;
+}
+
+// Similarity score with one 32-bit counter per value in [min, max] of
+// rhs, which has to have fewer than 2^32 elements
+constexpr int64_t similarity_histogram(const std::vector<int64_t>& lhs,
+				       const std::vector<int64_t>& rhs,
+				       int64_t min,
+				       int64_t max)
+{
+    std::vector<uint32_t> counts(static_cast<size_t>(max - min + 1));
+    for (int64_t x : rhs)
+	counts[static_cast<size_t>(x - min)]++;
+
+    int64_t score = 0;
+    for (int64_t x : lhs) {
+	if (x >= min && x <= max)
+	    score += x * int64_t{counts[static_cast<size_t>(x - min)]};
+    }
+    return score;
+}
+
+// Histogram when the IDs are dense enough for the counters to be
+// cheaper than sorting, merge-join otherwise. There are at most as many
+// 32-bit counters as values in both columns, half the memory of the
+// columns themselves, or 2^16 of them (256 KB) for small inputs.
+constexpr int64_t similarity_score(std::vector<int64_t>& lhs, std::vector<int64_t>& rhs)
+{
+    if (lhs.empty() || rhs.empty())
+	return 0;
+    auto [min, max] = std::minmax_element(rhs.begin(), rhs.end());
+    uint64_t range = static_cast<uint64_t>(*max) - static_cast<uint64_t>(*min);
+    if (rhs.size() <= std::numeric_limits<uint32_t>::max()
+	&& range < std::max<uint64_t>(1 << 16, lhs.size() + rhs.size()))
+	return similarity_histogram(lhs, rhs, *min, *max);
+    return similarity_merge(lhs, rhs);
+}
+
+constexpr Answer total_similarity(std::string_view input)
+{
+    std::vector<std::vector<int64_t>> columns = split_view_int_columns(input);
     CHECK(columns.size() == 2);
-    sort(columns[0].begin(), columns[0].end());
-    sort(columns[1].begin(), columns[1].end());
-    std::vector<int64_t> dists = compute_distances(columns[0], columns[1]);
-    return std::accumulate(dists.begin(), dists.end(), 0);
+    return similarity_score(columns[0], columns[1]);
 }
 
 Answer part_2(const std::string& input)
 {
-    std::vector<std::vector<int64_t>> columns = split_int_columns(input);
-    CHECK(columns.size() == 2);
-    std::unordered_map<int64_t, int64_t> counts = count_elements(columns[1]);
-    std::vector<int64_t> scores = compute_similarities(columns[0], counts);
-    return std::accumulate(scores.begin(), scores.end(), 0);
+    return total_similarity(input);
 }
 
-void tests()
+/////////////////////////////////////
+// Out-of-core mode
+//
+// For inputs larger than memory: the columns are read line by line
+// into buffers that fit the memory budget, and every time they fill up
+// they are sorted and written out as a run to an anonymous temporary
+// file. The runs of each column are then k-way merged, with the
+// distance taken on the merged columns in lockstep and the similarity
+// merge-joined alongside it, from a second cursor over the same runs.
+
+using TmpFile = std::shared_ptr<FILE>;
+
+TmpFile make_tmpfile()
 {
-    const char *test_input_1 =
-	"3   4\n"
-	"4   3\n"
-	"2   5\n"
-	"1   3\n"
-	"3   9\n"
-	"3   3\n";
+    FILE *f = std::tmpfile();
+    if (!f) {
+	throw std::runtime_error("Unable to create a temporary file");
+    }
+    return TmpFile(f, std::fclose);
+}
 
-    std::vector<std::vector<int64_t>> columns = split_int_columns(test_input_1);
+struct Run {
+    TmpFile file;
+    size_t size;
+};
+
+Run write_run(std::vector<int64_t>& nums)
+{
+    radix_sort(nums);
+    Run run{make_tmpfile(), nums.size()};
+    CHECK(std::fwrite(nums.data(), sizeof(int64_t), nums.size(), run.file.get())
+	  == nums.size());
+    nums.clear();
+    return run;
+}
+
+// Reads a run back block by block, with its own position so that
+// several cursors can share the file
+class RunCursor {
+public:
+    RunCursor(const Run& run, size_t block)
+	: m_run{run}, m_buf(std::min(block, run.size)) {}
+
+    std::optional<int64_t> peek() {
+	if (m_i == m_buf_size) {
+	    if (m_offset == m_run.size)
+		return {};
+	    m_buf_size = std::min(m_buf.size(), m_run.size - m_offset);
+	    CHECK(std::fseek(m_run.file.get(), ans(m_offset * sizeof(int64_t)), SEEK_SET) == 0);
+	    CHECK(std::fread(m_buf.data(), sizeof(int64_t), m_buf_size, m_run.file.get())
+		  == m_buf_size);
+	    m_offset += m_buf_size;
+	    m_i = 0;
+	}
+	return m_buf[m_i];
+    }
+
+    void pop() {
+	m_i++;
+    }
+
+private:
+    Run m_run;
+    std::vector<int64_t> m_buf;
+    size_t m_buf_size{0};
+    size_t m_i{0};
+    size_t m_offset{0};
+};
+
+// Sorted view of a column, merged from its runs
+class MergeCursor {
+public:
+    MergeCursor(const std::vector<Run>& runs, size_t block) {
+	for (const Run& run : runs) {
+	    m_cursors.emplace_back(run, block);
+	    std::optional<int64_t> x = m_cursors.back().peek();
+	    if (x)
+		m_heap.emplace(*x, m_cursors.size() - 1);
+	}
+    }
+
+    std::optional<int64_t> peek() const {
+	if (m_heap.empty())
+	    return {};
+	return m_heap.top().first;
+    }
+
+    std::optional<int64_t> next() {
+	if (m_heap.empty())
+	    return {};
+	auto [x, k] = m_heap.top();
+	m_heap.pop();
+	m_cursors[k].pop();
+	std::optional<int64_t> y = m_cursors[k].peek();
+	if (y)
+	    m_heap.emplace(*y, k);
+	return x;
+    }
+
+private:
+    using Entry = std::pair<int64_t, size_t>;
+    std::vector<RunCursor> m_cursors;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> m_heap;
+};
+
+// Merge-join step: the similarity of all the values up to `bound`
+int64_t join_up_to(MergeCursor& lhs, MergeCursor& rhs, int64_t bound)
+{
+    int64_t score = 0;
+    while (lhs.peek() && *lhs.peek() <= bound) {
+	int64_t x = *lhs.peek();
+	int64_t n_lhs = 0;
+	while (lhs.peek() == x) {
+	    lhs.next();
+	    n_lhs++;
+	}
+	while (rhs.peek() && *rhs.peek() < x)
+	    rhs.next();
+	int64_t n_rhs = 0;
+	while (rhs.peek() == x) {
+	    rhs.next();
+	    n_rhs++;
+	}
+	score += x * n_lhs * n_rhs;
+    }
+    return score;
+}
+
+struct Scores {
+    int64_t distance;
+    int64_t similarity;
+};
+
+// The numbers of one line, with the same rules as for the whole input in
+// split_view_int_columns: empty for a blank line
+std::vector<int64_t> parse_row(std::string_view line)
+{
+    std::vector<int64_t> row;
+    for (const std::vector<int64_t>& column : split_view_int_columns(line))
+	row.push_back(column.front());
+    return row;
+}
+
+// Both answers for the input read from `stream`, using about `budget`
+// bytes of memory
+Scores out_of_core_scores(std::istream& stream, size_t budget)
+{
+    // Two columns, each with a copy for the radix sort
+    size_t run_size = std::max<size_t>(budget / (4 * sizeof(int64_t)), 1);
+    std::vector<int64_t> lhs;
+    std::vector<int64_t> rhs;
+    lhs.reserve(run_size);
+    rhs.reserve(run_size);
+    std::vector<Run> lhs_runs;
+    std::vector<Run> rhs_runs;
+
+    std::string line;
+    while (std::getline(stream, line)) {
+	std::vector<int64_t> row = parse_row(line);
+	if (row.empty())
+	    continue;
+	CHECK(row.size() == 2);
+	lhs.push_back(row[0]);
+	rhs.push_back(row[1]);
+	if (lhs.size() == run_size) {
+	    lhs_runs.push_back(write_run(lhs));
+	    rhs_runs.push_back(write_run(rhs));
+	}
+    }
+    if (!lhs.empty()) {
+	lhs_runs.push_back(write_run(lhs));
+	rhs_runs.push_back(write_run(rhs));
+    }
+    lhs.shrink_to_fit();
+    rhs.shrink_to_fit();
+
+    // Four cursors (distance and join, for each column) over all the runs
+    size_t block = std::max<size_t>(
+	budget / (4 * sizeof(int64_t) * std::max<size_t>(lhs_runs.size(), 1)), 1);
+    MergeCursor dist_lhs(lhs_runs, block);
+    MergeCursor dist_rhs(rhs_runs, block);
+    MergeCursor join_lhs(lhs_runs, block);
+    MergeCursor join_rhs(rhs_runs, block);
+
+    Scores scores{0, 0};
+    while (true) {
+	std::optional<int64_t> x = dist_lhs.next();
+	std::optional<int64_t> y = dist_rhs.next();
+	CHECK(x.has_value() == y.has_value());
+	if (!x)
+	    break;
+	scores.distance += (*x > *y) ? *x - *y : *y - *x;
+	// Keep the join cursors just behind the distance ones
+	scores.similarity += join_up_to(join_lhs, join_rhs, std::min(*x, *y) - 1);
+    }
+    scores.similarity += join_up_to(join_lhs, join_rhs, std::numeric_limits<int64_t>::max());
+    return scores;
+}
+
+/////////////////////////////////////
+// Incremental mode
+//
+// Both answers kept up to date while single values are inserted in or
+// removed from either list, over a bounded ID domain [0, max_id].
+//
+// The similarity is sum(x * count_lhs(x) * count_rhs(x)), so an update
+// of x on one side changes it by x times the count of x on the other.
+//
+// For the distance, with C(t) the number of values <= t in a list,
+// pairing two sorted lists of the same size gives
+//     sum(|lhs_i - rhs_i|) = sum over t of |C_lhs(t) - C_rhs(t)|
+// and inserting x in lhs (rhs) adds 1 (-1) to the difference g(t) for
+// all t >= x. A segment tree over t keeps sum(|g|): a node whose values
+// all end up on the same side of zero takes the update lazily, so it
+// only descends into nodes holding both negative and positive values of
+// g. That is O((1 + B) log n) for B sign changes of g (zeros aside)
+// after the update, O(log n) when the lists interleave but O(n) for g
+// alternating between -1 and 1.
+
+class AbsSumTree {
+public:
+    explicit AbsSumTree(size_t size)
+	: m_size{size}, m_nodes(4 * std::max<size_t>(size, 1)) {
+	build(1, 0, m_size);
+    }
+
+    // g(t) += v for t in [lo, size)
+    void add_suffix(size_t lo, int64_t v) {
+	add(1, 0, m_size, lo, v);
+    }
+
+    int64_t abs_sum() const {
+	return m_nodes[1].abs_sum;
+    }
+
+private:
+    struct Node {
+	int64_t min{0};
+	int64_t max{0};
+	int64_t sum{0};
+	int64_t abs_sum{0};
+	int64_t lazy{0};
+	int64_t len{0};
+    };
+
+    void build(size_t k, size_t lo, size_t hi) {
+	m_nodes[k].len = ans(hi - lo);
+	if (hi - lo > 1) {
+	    size_t mid = lo + (hi - lo) / 2;
+	    build(2 * k, lo, mid);
+	    build(2 * k + 1, mid, hi);
+	}
+    }
+
+    // Only valid when the values all end up on the same side of zero
+    void apply(size_t k, int64_t v) {
+	Node& n = m_nodes[k];
+	n.min += v;
+	n.max += v;
+	n.sum += v * n.len;
+	n.abs_sum = (n.min >= 0) ? n.sum : -n.sum;
+	n.lazy += v;
+    }
+
+    void add(size_t k, size_t lo, size_t hi, size_t from, int64_t v) {
+	if (hi <= from)
+	    return;
+	Node& n = m_nodes[k];
+	bool same_sign = n.min + v >= 0 || n.max + v <= 0;
+	if (lo >= from && (same_sign || hi - lo == 1)) {
+	    apply(k, v);
+	    return;
+	}
+	size_t mid = lo + (hi - lo) / 2;
+	if (n.lazy != 0) {
+	    apply(2 * k, n.lazy);
+	    apply(2 * k + 1, n.lazy);
+	    n.lazy = 0;
+	}
+	add(2 * k, lo, mid, from, v);
+	add(2 * k + 1, mid, hi, from, v);
+	const Node& l = m_nodes[2 * k];
+	const Node& r = m_nodes[2 * k + 1];
+	n.min = std::min(l.min, r.min);
+	n.max = std::max(l.max, r.max);
+	n.sum = l.sum + r.sum;
+	n.abs_sum = l.abs_sum + r.abs_sum;
+    }
+
+    size_t m_size;
+    std::vector<Node> m_nodes;
+};
+
+enum Side { Left, Right };
+
+class IncrementalScores {
+public:
+    explicit IncrementalScores(int64_t max_id)
+	: m_max_id{max_id},
+	  m_counts{std::vector<int64_t>(static_cast<size_t>(max_id) + 1),
+		   std::vector<int64_t>(static_cast<size_t>(max_id) + 1)},
+	  m_diff(static_cast<size_t>(max_id) + 1) {
+	CHECK(max_id >= 0);
+    }
+
+    void insert(Side side, int64_t x) {
+	update(side, x, 1);
+    }
+
+    void erase(Side side, int64_t x) {
+	CHECK(x >= 0 && x <= m_max_id);
+	CHECK(m_counts[side][static_cast<size_t>(x)] > 0);
+	update(side, x, -1);
+    }
+
+    // Only defined for lists of the same size
+    int64_t distance() const {
+	CHECK(m_sizes[Left] == m_sizes[Right]);
+	return m_diff.abs_sum();
+    }
+
+    int64_t similarity() const {
+	return m_similarity;
+    }
+
+private:
+    void update(Side side, int64_t x, int64_t v) {
+	CHECK(x >= 0 && x <= m_max_id);
+	size_t i = static_cast<size_t>(x);
+	Side other = (side == Left) ? Right : Left;
+	m_similarity += v * x * m_counts[other][i];
+	m_counts[side][i] += v;
+	m_sizes[side] += v;
+	m_diff.add_suffix(i, (side == Left) ? v : -v);
+    }
+
+    int64_t m_max_id;
+    std::array<std::vector<int64_t>, 2> m_counts;
+    std::array<int64_t, 2> m_sizes{0, 0};
+    int64_t m_similarity{0};
+    AbsSumTree m_diff;
+};
+
+/////////////////////////////////////
+// Approximate mode
+//
+// For unbounded streams, in fixed memory: both columns go into
+// count-min sketches, the left one weighted by the ID, and the
+// similarity sum(x * count_lhs(x) * count_rhs(x)) is estimated as the
+// inner product of the two sketches. With IDs >= 0 the estimate never
+// undershoots, and overshoots by at most epsilon * sum(lhs) * size(rhs)
+// with probability 1 - delta.
+
+class CountMinSketch {
+public:
+    // width e / epsilon (rounded up to a power of 2) and depth ln(1 / delta)
+    CountMinSketch(double epsilon, double delta)
+	: m_width{std::bit_ceil(static_cast<size_t>(std::ceil(std::numbers::e / epsilon)))},
+	  m_depth{static_cast<size_t>(std::ceil(std::log(1 / delta)))} {
+	CHECK(epsilon > 0 && epsilon < 1);
+	CHECK(delta > 0 && delta < 1);
+	m_shift = 64 - std::countr_zero(m_width);
+	m_table.resize(m_width * m_depth);
+	// Fixed seeds, so that sketches of the same size can be combined
+	uint64_t seed = 0x9e3779b97f4a7c15;
+	for (size_t r = 0; r < m_depth; r++) {
+	    m_hashes.push_back({splitmix(seed) | 1, splitmix(seed)});
+	}
+    }
+
+    void add(int64_t x, int64_t weight = 1) {
+	for (size_t r = 0; r < m_depth; r++) {
+	    m_table[r * m_width + bucket(r, x)] += weight;
+	}
+	m_total += weight;
+    }
+
+    int64_t estimate(int64_t x) const {
+	int64_t est = std::numeric_limits<int64_t>::max();
+	for (size_t r = 0; r < m_depth; r++) {
+	    est = std::min(est, m_table[r * m_width + bucket(r, x)]);
+	}
+	return est;
+    }
+
+    int64_t inner_product(const CountMinSketch& other) const {
+	CHECK(m_width == other.m_width && m_depth == other.m_depth);
+	int64_t est = std::numeric_limits<int64_t>::max();
+	for (size_t r = 0; r < m_depth; r++) {
+	    int64_t sum = 0;
+	    for (size_t j = r * m_width; j < (r + 1) * m_width; j++) {
+		sum += m_table[j] * other.m_table[j];
+	    }
+	    est = std::min(est, sum);
+	}
+	return est;
+    }
+
+    int64_t total() const {
+	return m_total;
+    }
+
+    size_t size() const {
+	return m_table.size();
+    }
+
+private:
+    static uint64_t splitmix(uint64_t& state) {
+	uint64_t z = (state += 0x9e3779b97f4a7c15);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+	return z ^ (z >> 31);
+    }
+
+    // Multiply-shift hashing
+    size_t bucket(size_t r, int64_t x) const {
+	auto [a, b] = m_hashes[r];
+	return (m_width == 1) ? 0 : (a * static_cast<uint64_t>(x) + b) >> m_shift;
+    }
+
+    size_t m_width;
+    size_t m_depth;
+    int m_shift;
+    std::vector<std::pair<uint64_t, uint64_t>> m_hashes;
+    std::vector<int64_t> m_table;
+    int64_t m_total{0};
+};
+
+struct Estimate {
+    int64_t similarity;
+    // The exact answer is in [similarity - error, similarity] with
+    // probability confidence
+    int64_t error;
+    double confidence;
+};
+
+Estimate approximate_similarity(std::istream& stream, double epsilon, double delta)
+{
+    CountMinSketch lhs(epsilon, delta);
+    CountMinSketch rhs(epsilon, delta);
+    std::string line;
+    while (std::getline(stream, line)) {
+	std::vector<int64_t> row = parse_row(line);
+	if (row.empty())
+	    continue;
+	CHECK(row.size() == 2);
+	CHECK(row[0] >= 0 && row[1] >= 0);
+	lhs.add(row[0], row[0]);
+	rhs.add(row[1]);
+    }
+    double error = std::ceil(epsilon * static_cast<double>(lhs.total())
+			     * static_cast<double>(rhs.total()));
+    return {lhs.inner_product(rhs), static_cast<int64_t>(error), 1 - delta};
+}
+
+constexpr const char *test_input_1 =
+    "3   4\n"
+    "4   3\n"
+    "2   5\n"
+    "1   3\n"
+    "3   9\n"
+    "3   3\n";
+
+constexpr bool static_tests()
+{
+    std::vector<std::vector<int64_t>> columns = split_view_int_columns(test_input_1);
     CHECK(columns.size() == 2);
     CHECK(columns[0] == std::vector<int64_t>({3,4,2,1,3,3}));
     CHECK(columns[1] == std::vector<int64_t>({4,3,5,3,9,3}));
+    CHECK(columns[0].capacity() >= 6);
+    CHECK(split_view_int_columns("1 -2 3\n-4 5 6") ==
+	  std::vector<std::vector<int64_t>>({{1,-4},{-2,5},{3,6}}));
+    CHECK(split_view_int_columns("").empty());
+    // CRLF, tabs and blank lines
+    CHECK(split_view_int_columns("\n1\t -2\r\n\r\n-4   5\r\n\n") ==
+	  std::vector<std::vector<int64_t>>({{1,-4},{-2,5}}));
 
-    sort(columns[0].begin(), columns[0].end());
-    sort(columns[1].begin(), columns[1].end());
+    std::sort(columns[0].begin(), columns[0].end());
+    std::sort(columns[1].begin(), columns[1].end());
     std::vector<int64_t> dists = compute_distances(columns[0], columns[1]);
     CHECK(dists == std::vector<int64_t>({2,1,0,1,2,5}));
+    CHECK(sum_distances(columns[0], columns[1]) == 11);
+    CHECK(total_distance(test_input_1) == 11);
+
+    std::vector<int64_t> nums = {70000, 3, 256, 0, 255, 1ll << 40, 3, 65536};
+    radix_sort(nums);
+    CHECK(std::is_sorted(nums.begin(), nums.end()));
+    CHECK(nums.front() == 0 && nums.back() == (1ll << 40));
+    nums = {5, -2, 7, -9};
+    radix_sort(nums);
+    CHECK(nums == std::vector<int64_t>({-9,-2,5,7}));
+
+    // Doesn't overflow 32 bits
+    CHECK(sum_distances({0, 0}, {3000000000, -3000000000}) == 6000000000);
+
+    /////////////////////////////////////
+
+    columns = split_view_int_columns(test_input_1);
+    CHECK(similarity_histogram(columns[0], columns[1], 3, 9) == 31);
+    CHECK(similarity_merge(columns[0], columns[1]) == 31);
+    CHECK(total_similarity(test_input_1) == 31);
+
+    std::vector<int64_t> lhs = {1, 1000000000, 5, 1000000000};
+    std::vector<int64_t> rhs = {1000000000, 5, 2, 1000000000, 5};
+    CHECK(similarity_score(lhs, rhs) == 4000000010);
+
+    return true;
+}
+
+static_assert(static_tests());
+
+void tests()
+{
+    std::stringstream stream(test_input_1);
+    CHECK(split_int_columns(stream) == split_view_int_columns(test_input_1));
     CHECK(part_1(test_input_1) == 11);
 
+    std::string crlf_input;
+    for (std::string_view line : split_view_lines(test_input_1))
+	crlf_input += std::string(line) + "\r\n";
+    stream = std::stringstream(crlf_input);
+    CHECK(split_int_columns(stream) == split_view_int_columns(test_input_1));
+    CHECK(split_int_columns(crlf_input) == split_view_int_columns(test_input_1));
+    CHECK(part_1(crlf_input) == 11);
+    CHECK(part_2(crlf_input) == 31);
+
+    // Numbers that don't fit throw, as std::stoll did
+    CHECK(split_view_int_columns("9223372036854775807 -9223372036854775807")
+	  == std::vector<std::vector<int64_t>>({{9223372036854775807}, {-9223372036854775807}}));
+    for (std::string_view overflow : {"1 9223372036854775808", "99999999999999999999 1"}) {
+	bool threw = false;
+	try {
+	    split_view_int_columns(overflow);
+	} catch (std::runtime_error&) {
+	    threw = true;
+	}
+	CHECK(threw);
+    }
+
     /////////////////////////////////////
 
-    columns = split_int_columns(test_input_1);
+    std::vector<std::vector<int64_t>> columns = split_int_columns(test_input_1);
     CHECK(columns.size() == 2);
     std::unordered_map<int64_t, int64_t> counts = count_elements(columns[1]);
     CHECK(counts.size() == 4);
@@ -87,7 +721,105 @@ void tests()
     std::vector<int64_t> scores = compute_similarities(columns[0], counts);
     CHECK(scores == std::vector<int64_t>({9,4,0,0,9,9}));
     CHECK(part_2(test_input_1) == 31);
+
+    /////////////////////////////////////
+
+    // Runs of 2 lines, then of all of them
+    stream = std::stringstream(test_input_1);
+    Scores s = out_of_core_scores(stream, 2 * 4 * sizeof(int64_t));
+    CHECK(s.distance == 11);
+    CHECK(s.similarity == 31);
+    stream = std::stringstream(test_input_1);
+    s = out_of_core_scores(stream, 1 << 20);
+    CHECK(s.distance == 11);
+    CHECK(s.similarity == 31);
+    // CRLF, tabs and blank lines, as for the other modes
+    std::string messy = "\n" + crlf_input + "\r\n1\t2\n\n";
+    stream = std::stringstream(messy);
+    s = out_of_core_scores(stream, 2 * 4 * sizeof(int64_t));
+    CHECK(s.distance == part_1(messy));
+    CHECK(s.similarity == part_2(messy));
+
+    std::string big;
+    for (int64_t i = 0; i < 5000; i++) {
+	big += std::to_string((i * 7919) % 1013) + "   " + std::to_string((i * 104729) % 997) + "\n";
+    }
+    stream = std::stringstream(big);
+    s = out_of_core_scores(stream, 4096);
+    CHECK(s.distance == part_1(big));
+    CHECK(s.similarity == part_2(big));
+
+    /////////////////////////////////////
+
+    IncrementalScores inc(9);
+    columns = split_int_columns(test_input_1);
+    for (size_t i = 0; i < columns[0].size(); i++) {
+	inc.insert(Left, columns[0][i]);
+	inc.insert(Right, columns[1][i]);
+    }
+    CHECK(inc.distance() == 11);
+    CHECK(inc.similarity() == 31);
+
+    // Against recomputing from scratch after each pair of updates
+    std::vector<int64_t> lhs;
+    std::vector<int64_t> rhs;
+    IncrementalScores inc2(1000);
+    for (int64_t i = 0; i < 2000; i++) {
+	if (i % 5 == 4) {
+	    inc2.erase(Left, lhs[static_cast<size_t>(i) % lhs.size()]);
+	    lhs.erase(lhs.begin() + i % ans(lhs.size()));
+	    inc2.erase(Right, rhs[static_cast<size_t>(i * 7) % rhs.size()]);
+	    rhs.erase(rhs.begin() + (i * 7) % ans(rhs.size()));
+	} else {
+	    lhs.push_back((i * 7919) % 1001);
+	    inc2.insert(Left, lhs.back());
+	    rhs.push_back((i * 104729) % 997);
+	    inc2.insert(Right, rhs.back());
+	}
+	std::vector<int64_t> lhs_ = lhs;
+	std::vector<int64_t> rhs_ = rhs;
+	radix_sort(lhs_);
+	radix_sort(rhs_);
+	CHECK(inc2.distance() == sum_distances(lhs_, rhs_));
+	CHECK(inc2.similarity() == similarity_merge(lhs_, rhs_));
+    }
+
+    // Interleaved lists, g alternating between 0 and 1
+    IncrementalScores inc3(1000);
+    for (int64_t x = 0; x < 1000; x += 2) {
+	inc3.insert(Left, x);
+	inc3.insert(Right, x + 1);
+	CHECK(inc3.distance() == x / 2 + 1);
+    }
+    for (int64_t x = 0; x < 1000; x += 4) {
+	inc3.erase(Right, x + 1);
+	inc3.insert(Right, x);
+    }
+    CHECK(inc3.distance() == 250);
+    CHECK(inc3.similarity() == 250 * 498);
+
+    /////////////////////////////////////
+
+    CountMinSketch sketch(0.01, 0.01);
+    CHECK(sketch.size() == 512 * 5);
+    for (int64_t x : {3, 4, 3, 9, 3})
+	sketch.add(x);
+    CHECK(sketch.estimate(3) >= 3);
+    CHECK(sketch.estimate(4) >= 1);
+    CHECK(sketch.total() == 5);
+
+    stream = std::stringstream(test_input_1);
+    Estimate e = approximate_similarity(stream, 0.01, 0.01);
+    CHECK(e.similarity >= 31 && e.similarity - e.error <= 31);
+    CHECK(e.confidence == 0.99);
+    stream = std::stringstream(messy);
+    e = approximate_similarity(stream, 0.01, 0.01);
+    CHECK(e.similarity >= part_2(messy) && e.similarity - e.error <= part_2(messy));
+
+    // Same memory whatever the number of distinct IDs
+    stream = std::stringstream(big);
+    e = approximate_similarity(stream, 0.001, 0.001);
+    CHECK(e.similarity >= part_2(big) && e.similarity - e.error <= part_2(big));
 }
 
 } //namespace day1
-
@@ -1,4 +1,3 @@
-#include <list>
 #include <map>
 #include <numeric>
 
@@ -6,12 +5,14 @@
 
 namespace day11 {
 
-using InputData = std::list<uint64_t>;
+using InputData = std::vector<uint64_t>;
 
-InputData read_input_data(const std::string& input)
+constexpr InputData read_input_data(std::string_view input)
 {
-    std::vector<int64_t> ints = split_ints(input);
-    std::list<uint64_t> uints;
+    std::vector<std::string_view> lines = split_view_lines(input);
+    CHECK(lines.size() == 1);
+    std::vector<int64_t> ints = split_view_ints(lines.front());
+    std::vector<uint64_t> uints;
     std::transform(ints.begin(), ints.end(), std::back_inserter(uints),
 		   [](int64_t i){return static_cast<uint64_t>(i);});
     return uints;
@@ -61,30 +62,46 @@ InputData read_input_data(const std::string& input)
 
 using Cache = std::map<std::pair<uint64_t, uint64_t>, uint64_t>;
 
-void blink(InputData& data, uint64_t n = 1)
+using Halves = std::pair<uint64_t, uint64_t>;
+
+// Split x in two halves of its decimal digits, if it has an even number
+constexpr std::optional<Halves> split_digits(uint64_t x)
+{
+    uint64_t half = 10;
+    uint64_t lower = 1;
+    while (x / half >= half) {
+	half *= 10;
+	lower *= 10;
+    }
+    // Even number of digits iff 10^(2k-1) <= x < 10^(2k)
+    if (x < lower * half)
+	return {};
+    return Halves(x / half, x % half);
+}
+
+constexpr void blink(InputData& data, uint64_t n = 1)
 {
     for (uint64_t in = 0; in < n; in++) {
-	for (auto it = data.begin(); it != data.end(); it++) {
-	    if (*it == 0) {
-		*it = 1;
+	InputData next;
+	next.reserve(data.size() * 2);
+	for (uint64_t x : data) {
+	    if (x == 0) {
+		next.push_back(1);
 		continue;
 	    }
 
-	    std::string istr = std::to_string(*it);
-	    if (istr.size() % 2 == 0) {
-		uint64_t half = istr.size() / 2;
-		uint64_t lhs = std::stoull(istr.substr(0, half));
-		uint64_t rhs = std::stoull(istr.substr(half, half));
-		data.insert(it, lhs);
-		*it = rhs;
+	    std::optional<Halves> halves = split_digits(x);
+	    if (halves) {
+		next.push_back(halves->first);
+		next.push_back(halves->second);
 		continue;
 	    }
 
-	    uint64_t a = *it;
 	    uint64_t b = 2024;
-	    *it = a * b;
-	    CHECK(!(a != 0 && *it / a != b)); // Overflow!
+	    CHECK(x <= std::numeric_limits<uint64_t>::max() / b); // Overflow!
+	    next.push_back(x * b);
 	}
+	data = std::move(next);
     }
 }
 
@@ -99,9 +116,9 @@ uint64_t length_blink(Cache& cache, uint64_t x, uint64_t n)
 	return it->second;
     }
 
-    std::list<uint64_t> xs = {x};
+    InputData xs = {x};
     blink(xs);
-    cache.insert({{x, 1}, static_cast<uint64_t>(std::distance(xs.begin(), xs.end()))});
+    cache.insert({{x, 1}, xs.size()});
     
     uint64_t l = std::accumulate(xs.begin(), xs.end(), 0ull,
 				 [&](uint64_t acc, uint64_t y){
@@ -121,70 +138,114 @@ uint64_t length_blink(const InputData& data, uint64_t n)
 			   });
 }
 
+// Same as length_blink, but keeping one (value, count) entry per
+// distinct stone instead of a map cache, so that it is constexpr
+using Counts = std::vector<std::pair<uint64_t, uint64_t>>;
+
+constexpr uint64_t count_blink(const InputData& data, uint64_t n)
+{
+    Counts counts;
+    for (uint64_t x : data)
+	counts.emplace_back(x, 1);
+
+    for (uint64_t in = 0; in < n; in++) {
+	Counts next;
+	for (auto [x, c] : counts) {
+	    InputData xs = {x};
+	    blink(xs);
+	    for (uint64_t y : xs)
+		next.emplace_back(y, c);
+	}
+	std::sort(next.begin(), next.end());
+	counts.clear();
+	for (auto [y, c] : next) {
+	    if (!counts.empty() && counts.back().first == y)
+		counts.back().second += c;
+	    else
+		counts.emplace_back(y, c);
+	}
+    }
+
+    return std::accumulate(counts.begin(), counts.end(), 0ull,
+			   [](uint64_t acc, const auto& xc){
+			       return acc + xc.second;
+			   });
+}
 
 Answer part_1(const std::string& input)
 {
     InputData data = read_input_data(input);
-    return ans(length_blink(data, 25));
+    return ans(count_blink(data, 25));
 }
 
 Answer part_2(const std::string& input)
 {
     InputData data = read_input_data(input);
-    return ans(length_blink(data, 75));
+    return ans(count_blink(data, 75));
 }
 
-void tests()
-{
-    std::vector<const char *> test_input = {
-	// 0
-	"0 1 10 99 999",
-	// 1
-	"125 17"
-    };
+constexpr const char *test_input_0 = "0 1 10 99 999\n";
+constexpr const char *test_input_1 = "125 17";
 
-    std::vector<InputData> test_data;
-    std::transform(test_input.begin(), test_input.end(),
-		   std::back_inserter(test_data), read_input_data);
+constexpr bool static_tests()
+{
+    CHECK(read_input_data(test_input_0) == InputData({0,1,10,99,999}));
 
-    CHECK(test_data[0] == std::list<uint64_t>({0,1,10,99,999}));
+    CHECK(!split_digits(1));
+    CHECK(split_digits(10) == Halves(1, 0));
+    CHECK(!split_digits(999));
+    CHECK(split_digits(2024) == Halves(20, 24));
+    CHECK(split_digits(28676032) == Halves(2867, 6032));
+    CHECK(!split_digits(2021976));
 
-    std::list<uint64_t> copy = test_data[0];
+    InputData copy = read_input_data(test_input_0);
     blink(copy);
-    CHECK(copy == std::list<uint64_t>({1,2024,1,0,9,9,2021976}));
+    CHECK(copy == InputData({1,2024,1,0,9,9,2021976}));
 
-    copy = test_data[1];
-    CHECK(length_blink(copy, 1) == length_blink(test_data[1], 1));
+    copy = read_input_data(test_input_1);
     blink(copy);
-    CHECK(copy == std::list<uint64_t>({253000,1,7}));
-    CHECK(length_blink(test_data[1], 1) == 3);
-    CHECK(length_blink(copy, 1) == length_blink(test_data[1], 2));
+    CHECK(copy == InputData({253000,1,7}));
     blink(copy);
-    CHECK(copy == std::list<uint64_t>({253,0,2024,14168}));
-    CHECK(length_blink(test_data[1], 2) == 4);
-    CHECK(length_blink(copy, 1) == length_blink(test_data[1], 3));
+    CHECK(copy == InputData({253,0,2024,14168}));
     blink(copy);
-    CHECK(copy == std::list<uint64_t>({512072,1,20,24,28676032}));
-    CHECK(length_blink(test_data[1], 3) == 5);
-    CHECK(length_blink(copy, 1) == length_blink(test_data[1], 4));
+    CHECK(copy == InputData({512072,1,20,24,28676032}));
     blink(copy);
-    CHECK(copy == std::list<uint64_t>({512,72,2024,2,0,2,4,2867,6032}));
-    CHECK(length_blink(test_data[1], 4) == 9);
-    CHECK(length_blink(copy, 1) == length_blink(test_data[1], 5));
+    CHECK(copy == InputData({512,72,2024,2,0,2,4,2867,6032}));
     blink(copy);
-    CHECK(copy == std::list<uint64_t>({1036288,7,2,20,24,4048,1,4048,8096,28,67,60,32}));
-    CHECK(length_blink(test_data[1], 5) == 13);
-    CHECK(length_blink(copy, 1) == length_blink(test_data[1], 6));
+    CHECK(copy == InputData({1036288,7,2,20,24,4048,1,4048,8096,28,67,60,32}));
     blink(copy);
-    CHECK(copy == std::list<uint64_t>({2097446912,14168,4048,2,0,2,4,40,48,2024,40,48,80,96,2,8,6,7,6,0,3,2}));
-    CHECK(length_blink(test_data[1], 6) == 22);
+    CHECK(copy == InputData({2097446912,14168,4048,2,0,2,4,40,48,2024,40,48,80,96,2,8,6,7,6,0,3,2}));
 
-    copy = test_data[1];
-    blink(copy, 25);
-    CHECK(std::distance(copy.begin(), copy.end()) == 55312);
+    copy = read_input_data(test_input_1);
+    blink(copy, 3);
+    CHECK(copy.size() == 5);
+    CHECK(count_blink(read_input_data(test_input_1), 3) == 5);
+    CHECK(count_blink(read_input_data(test_input_1), 6) == 22);
+    CHECK(count_blink(read_input_data(test_input_1), 25) == 55312);
 
-    CHECK(part_1(test_input[1]) == 55312);
+    return true;
 }
 
-} //namespace day11
+static_assert(static_tests());
 
+void tests()
+{
+    InputData data = read_input_data(test_input_1);
+    InputData copy = data;
+    for (uint64_t n = 1; n <= 6; n++) {
+	CHECK(length_blink(copy, 1) == length_blink(data, n));
+	blink(copy);
+    }
+    CHECK(length_blink(data, 1) == 3);
+    CHECK(length_blink(data, 2) == 4);
+    CHECK(length_blink(data, 3) == 5);
+    CHECK(length_blink(data, 4) == 9);
+    CHECK(length_blink(data, 5) == 13);
+    CHECK(length_blink(data, 6) == 22);
+    CHECK(length_blink(data, 25) == 55312);
+    CHECK(length_blink(data, 75) == count_blink(data, 75));
+
+    CHECK(part_1(test_input_1) == 55312);
+}
+
+} //namespace day11
@@ -16,14 +16,19 @@ struct Cell {
     size_t j;
 };
 
-Cell make_cell(size_t i, size_t j, char c)
+// The grid itself only stores the label and type of each cell, one
+// array each, and the position comes from the index
+enum Field : size_t { Label, Type };
+using CellGrid = Grid<SoA<uint64_t, char>>;
+
+std::tuple<uint64_t, char> make_cell(size_t, size_t, char c)
 {
-    return Cell{0, c, i, j};
+    return {0, c};
 }
 
-Grid<Cell> read_input_data(const std::string& input)
+CellGrid read_input_data(const std::string& input)
 {
-    return Grid<Cell>(input, make_cell);
+    return CellGrid(input, make_cell);
 }
 
 class DisjointSets {
@@ -60,61 +65,62 @@ private:
     boost::disjoint_sets<std::size_t*, std::size_t*> m_ds;
 };
 
-void label_clusters(Grid<Cell>& grid)
+void label_clusters(CellGrid& grid)
 {
     DisjointSets ds{};
+    std::vector<uint64_t>& label = grid.field<Label>();
+    const std::vector<char>& type = grid.field<Type>();
 
     for (size_t i = 0; i < grid.nrows; i++) {
 	for (size_t j = 0; j < grid.ncols; j++) {
+	    size_t k = grid.idx(i, j);
 	    // Allocate label if needed
-	    if (grid.at(i, j).label == 0) {
-		grid.ref(i, j).label = ds.makeSet();
+	    if (label[k] == 0) {
+		label[k] = ds.makeSet();
 	    }
 	    // Check left
-	    if (j > 0 && grid.at(i, j).type == grid.at(i, j - 1).type) {
-		CHECK(grid.at(i, j).label != 0);
-		CHECK(grid.at(i, j - 1).label != 0);
-		ds.unionSet(grid.at(i, j).label, grid.at(i, j - 1).label);
+	    if (j > 0 && type[k] == type[k - 1]) {
+		CHECK(label[k - 1] != 0);
+		ds.unionSet(label[k], label[k - 1]);
 	    }
 	    // Check up
-	    if (i > 0 && grid.at(i, j).type == grid.at(i - 1, j).type) {
-		CHECK(grid.at(i, j).label != 0);
-		CHECK(grid.at(i - 1, j).label != 0);
-		ds.unionSet(grid.at(i, j).label, grid.at(i - 1, j).label);
+	    if (i > 0 && type[k] == type[k - grid.ncols]) {
+		CHECK(label[k - grid.ncols] != 0);
+		ds.unionSet(label[k], label[k - grid.ncols]);
 	    }
 
 	}
     }
 
     // Merge labels
-    for (size_t i = 0; i < grid.nrows; i++) {
-	for (size_t j = 0; j < grid.ncols; j++) {
-	    grid.ref(i, j).label = ds.findSet(grid.at(i, j).label);
-	}
+    for (uint64_t& l : label) {
+	l = ds.findSet(l);
     }
 }
 
 using Region = std::vector<Cell>;
-std::vector<Region> make_regions(Grid<Cell> grid)
+std::vector<Region> make_regions(const CellGrid& grid)
 {
-    if (grid.m_buf.empty()) {
+    if (grid.size() == 0) {
 	return {};
     }
 
-    std::sort(grid.m_buf.begin(), grid.m_buf.end(),
-	      [](auto lhs, auto rhs){return lhs.label < rhs.label;});
-
+    const std::vector<uint64_t>& label = grid.field<Label>();
+    std::vector<size_t> order(grid.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+	      [&](size_t lhs, size_t rhs){return label[lhs] < label[rhs];});
 
     Region r;
     std::vector<Region> rs;
-    uint64_t l = grid.m_buf.front().label;
-    for (auto& cell : grid.m_buf) {
-	if (cell.label != l) {
+    uint64_t l = label[order.front()];
+    for (size_t k : order) {
+	if (label[k] != l) {
 	    rs.push_back(std::move(r));
 	    r = Region();
-	    l = cell.label;
+	    l = label[k];
 	}
-	r.push_back(std::move(cell));
+	r.push_back({label[k], grid.at<Type>(k), grid.row(k), grid.col(k)});
     }
     rs.push_back(std::move(r));
     return rs;
@@ -122,9 +128,9 @@ std::vector<Region> make_regions(Grid<Cell> grid)
 
 std::vector<Region> get_regions(const std::string& input)
 {
-    Grid<Cell> grid = read_input_data(input);
+    CellGrid grid = read_input_data(input);
     label_clusters(grid);
-    return make_regions(std::move(grid));
+    return make_regions(grid);
 }
 
 uint64_t calculate_perimeter(const Region& r)
@@ -394,7 +400,7 @@ void tests()
 
     };
 
-    std::vector<Grid<Cell>> grids;
+    std::vector<CellGrid> grids;
     std::transform(test_input.begin(),
 		   test_input.end(),
 		   std::back_inserter(grids),
@@ -403,10 +409,12 @@ void tests()
     CHECK(grids.size() == test_input.size());
     CHECK(grids[0].nrows == 4);
     CHECK(grids[0].ncols == 4);
-    CHECK(grids[0].at(0, 0).label == 0);
-    CHECK(grids[0].at(0, 0).type == 'A');
-    CHECK(grids[0].at(0, 0).i == 0);
-    CHECK(grids[0].at(0, 0).j == 0);
+    CHECK(grids[0].at<Label>(0, 0) == 0);
+    CHECK(grids[0].at<Type>(0, 0) == 'A');
+    CHECK(grids[0].at<Type>(1, 3) == 'D');
+    CHECK(grids[0].row(grids[0].idx(1, 3)) == 1);
+    CHECK(grids[0].col(grids[0].idx(1, 3)) == 3);
+    CHECK(grids[0].field<Type>().size() == 16);
 
     label_clusters(grids[0]);
     std::vector<Region> regions = make_regions(grids[0]);
@@ -1,8 +1,17 @@
+#include <array>
+#include <bit>
+#include <numeric>
+#include <span>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "common.hpp"
 
 namespace day2 {
 
-std::vector<int64_t> compute_diffs(const std::vector<int64_t>& nums)
+constexpr std::vector<int64_t> compute_diffs(const std::vector<int64_t>& nums)
 {
     std::vector<int64_t> diffs;
     for (size_t i = 1; i < nums.size(); i++) {
@@ -15,7 +24,7 @@ enum Change {
     Increase, Decrease, None
 };
 
-Change change(int64_t x)
+constexpr Change change(int64_t x)
 {
     if (x > 0)
 	return Increase;
@@ -24,18 +33,17 @@ Change change(int64_t x)
     return None;
 }
 
-bool is_report_safe(const std::vector<int64_t>& nums)
+constexpr bool is_report_safe(const std::vector<int64_t>& nums)
 {
     std::vector<int64_t> diffs = compute_diffs(nums);
     CHECK(!diffs.empty());
     return std::all_of(diffs.begin(), diffs.end(), [&](int64_t x) {
 	return (change(x) == change(diffs[0])) &&
-	    (std::abs(x) >= 1) &&
-	    (std::abs(x) <= 3);
+	    (x >= -3) && (x <= 3) && (x != 0);
     });
 }
 
-bool is_report_safe(const std::vector<int64_t>& nums, size_t i_skip)
+constexpr bool is_report_safe(const std::vector<int64_t>& nums, size_t i_skip)
 {
     std::vector<int64_t> nums_;
     for (size_t i = 0; i < nums.size(); i++) {
@@ -46,7 +54,7 @@ bool is_report_safe(const std::vector<int64_t>& nums, size_t i_skip)
     return is_report_safe(nums_);
 }
 
-bool is_report_safe_2(const std::vector<int64_t>& nums)
+constexpr bool is_report_safe_2(const std::vector<int64_t>& nums)
 {
     if (!is_report_safe(nums)) {
 	for (size_t i_skip = 0; i_skip < nums.size(); i_skip++) {
@@ -59,34 +67,276 @@ bool is_report_safe_2(const std::vector<int64_t>& nums)
     }
 }
 
+// Single pass version of is_report_safe_2, without copies: for a given
+// direction, only removing one of the two levels of the first bad step
+// can help, so there are at most four candidates to check.
 
-Answer part_1(const std::string& input)
+// The first i such that nums[i] to nums[i + 1] isn't a step of 1 to 3
+// in direction dir (1 or -1), nums.size() if there is none
+constexpr size_t first_bad_step(std::span<const int64_t> nums, int64_t dir)
+{
+    for (size_t i = 0; i + 1 < nums.size(); i++) {
+	int64_t d = (nums[i + 1] - nums[i]) * dir;
+	if (d < 1 || d > 3)
+	    return i;
+    }
+    return nums.size();
+}
+
+constexpr bool steps_ok(std::span<const int64_t> nums, int64_t dir, size_t i_skip)
+{
+    size_t prev = nums.size();
+    for (size_t i = 0; i < nums.size(); i++) {
+	if (i == i_skip)
+	    continue;
+	if (prev != nums.size()) {
+	    int64_t d = (nums[i] - nums[prev]) * dir;
+	    if (d < 1 || d > 3)
+		return false;
+	}
+	prev = i;
+    }
+    return true;
+}
+
+constexpr bool is_report_safe_dampened(std::span<const int64_t> nums)
+{
+    for (int64_t dir : {1, -1}) {
+	size_t i = first_bad_step(nums, dir);
+	if (i == nums.size() || steps_ok(nums, dir, i) || steps_ok(nums, dir, i + 1))
+	    return true;
+    }
+    return false;
+}
+
+constexpr bool is_report_safe_dampened(const std::vector<int64_t>& nums)
+{
+    return is_report_safe_dampened(std::span<const int64_t>(nums));
+}
+
+// Either check, in place
+constexpr bool check_report(std::span<const int64_t> nums, bool dampener)
+{
+    CHECK(nums.size() >= 2);
+    if (dampener)
+	return is_report_safe_dampened(nums);
+    return first_bad_step(nums, 1) == nums.size() || first_bad_step(nums, -1) == nums.size();
+}
+
+// Safe after removing at most k levels: for each direction, the fewest
+// removals for a valid chain ending at level i is either all the levels
+// before it, or the fewest for a chain ending at one of the k + 1 levels
+// before it plus the ones in between, so O(n k) overall.
+constexpr bool is_report_safe_k(const std::vector<int64_t>& nums, size_t k)
 {
-    std::vector<std::vector<int64_t>> num_lines = split_int_lines(input);
-    return std::count_if(num_lines.begin(), num_lines.end(), [](const auto& r){
-	return is_report_safe(r);
+    size_t n = nums.size();
+    std::vector<size_t> removals(n);
+    for (int64_t dir : {1, -1}) {
+	for (size_t i = 0; i < n; i++) {
+	    removals[i] = i;
+	    for (size_t p = (i > k + 1) ? i - k - 1 : 0; p < i; p++) {
+		int64_t d = (nums[i] - nums[p]) * dir;
+		if (d >= 1 && d <= 3)
+		    removals[i] = std::min(removals[i], removals[p] + (i - p - 1));
+	    }
+	    // And all the levels after it
+	    if (removals[i] + (n - 1 - i) <= k)
+		return true;
+	}
+    }
+    return false;
+}
+
+constexpr Answer count_safe_reports(std::string_view input, bool dampener)
+{
+    std::vector<std::vector<int64_t>> num_lines = split_view_int_lines(input);
+    return std::count_if(num_lines.begin(), num_lines.end(), [=](const auto& r){
+	return dampener ? is_report_safe_dampened(r) : is_report_safe(r);
     });
 }
 
-Answer part_2(const std::string& input)
+/////////////////////////////////////
+// Batched mode
+//
+// Reports are short, so blocks of 16 of them are packed transposed, one
+// level of every report per 16-byte vector, and checked lane-wise with
+// vector compares. Padding levels are masked out by the report sizes.
+// The dampened check is the plain one repeated with each level skipped.
+
+constexpr size_t BlockLanes = 16;
+constexpr size_t BlockLevels = 8;
+
+struct ReportBlock {
+    // levels[k][lane] is level k of report `lane`
+    std::array<std::array<int8_t, BlockLanes>, BlockLevels> levels{};
+    std::array<int8_t, BlockLanes> sizes{};
+    size_t count{0};
+
+    // False if the report doesn't fit in a lane
+    bool push(std::span<const int64_t> nums) {
+	CHECK(count < BlockLanes);
+	if (nums.size() < 2 || nums.size() > BlockLevels)
+	    return false;
+	if (std::any_of(nums.begin(), nums.end(), [](int64_t x) { return x < 0 || x > 127; }))
+	    return false;
+	for (size_t k = 0; k < nums.size(); k++)
+	    levels[k][count] = static_cast<int8_t>(nums[k]);
+	sizes[count] = static_cast<int8_t>(nums.size());
+	count++;
+	return true;
+    }
+};
+
+#ifdef __SSE2__
+// Lanes whose report is safe once level `skip` is removed (none removed
+// if skip >= BlockLevels)
+__m128i safe_lanes(const __m128i (&levels)[BlockLevels], __m128i sizes, size_t skip)
+{
+    __m128i inc = _mm_set1_epi8(-1);
+    __m128i dec = _mm_set1_epi8(-1);
+    size_t prev = (skip == 0) ? 1 : 0;
+    for (size_t k = prev + 1; k < BlockLevels; k++) {
+	if (k == skip)
+	    continue;
+	__m128i d = _mm_sub_epi8(levels[k], levels[prev]);
+	__m128i valid = _mm_cmpgt_epi8(sizes, _mm_set1_epi8(static_cast<char>(k)));
+	__m128i inc_ok = _mm_and_si128(_mm_cmpgt_epi8(d, _mm_setzero_si128()),
+				       _mm_cmplt_epi8(d, _mm_set1_epi8(4)));
+	__m128i dec_ok = _mm_and_si128(_mm_cmplt_epi8(d, _mm_setzero_si128()),
+				       _mm_cmpgt_epi8(d, _mm_set1_epi8(-4)));
+	inc = _mm_andnot_si128(_mm_andnot_si128(inc_ok, valid), inc);
+	dec = _mm_andnot_si128(_mm_andnot_si128(dec_ok, valid), dec);
+	prev = k;
+    }
+    return _mm_or_si128(inc, dec);
+}
+#endif
+
+// Bit i is set if report i of the block is safe
+uint32_t safe_mask(const ReportBlock& block, bool dampener)
+{
+    uint32_t mask = 0;
+#ifdef __SSE2__
+    __m128i levels[BlockLevels];
+    for (size_t k = 0; k < BlockLevels; k++) {
+	levels[k] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block.levels[k].data()));
+    }
+    __m128i sizes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block.sizes.data()));
+    __m128i safe = safe_lanes(levels, sizes, BlockLevels);
+    if (dampener) {
+	for (size_t skip = 0; skip < BlockLevels; skip++) {
+	    __m128i in_report = _mm_cmpgt_epi8(sizes, _mm_set1_epi8(static_cast<char>(skip)));
+	    safe = _mm_or_si128(safe, _mm_and_si128(in_report, safe_lanes(levels, sizes, skip)));
+	}
+    }
+    mask = static_cast<uint32_t>(_mm_movemask_epi8(safe));
+#else
+    for (size_t i = 0; i < block.count; i++) {
+	std::vector<int64_t> nums;
+	for (size_t k = 0; k < static_cast<size_t>(block.sizes[i]); k++)
+	    nums.push_back(block.levels[k][i]);
+	if (dampener ? is_report_safe_dampened(nums) : is_report_safe(nums))
+	    mask |= 1u << i;
+    }
+#endif
+    return mask & ((1u << block.count) - 1);
+}
+
+constexpr size_t MaxLevels = 32;
+
+// Same as count_safe_reports, in one pass and without allocations: the
+// levels of each line are parsed into a fixed buffer, and the reports
+// that fit are checked in blocks. The rare lines longer than the buffer
+// spill into a vector, and carriage returns count as spaces.
+Answer count_safe_reports_batched(std::string_view input, bool dampener)
+{
+    Answer count = 0;
+    ReportBlock block;
+    std::array<int64_t, MaxLevels> levels;
+    std::vector<int64_t> spill;
+    size_t n = 0;
+    int64_t x = 0;
+    bool in_num = false;
+    bool negative = false;
+    for (size_t i = 0; i <= input.size(); i++) {
+	char c = (i < input.size()) ? input[i] : '\n';
+	if (c >= '0' && c <= '9') {
+	    x = push_digit(x, c);
+	    in_num = true;
+	    continue;
+	}
+	if (c == '-' && !in_num && !negative) {
+	    negative = true;
+	    continue;
+	}
+	CHECK(in_num || !negative);
+	if (in_num) {
+	    if (n < MaxLevels) {
+		levels[n] = negative ? -x : x;
+	    } else {
+		if (n == MaxLevels)
+		    spill.assign(levels.begin(), levels.end());
+		spill.push_back(negative ? -x : x);
+	    }
+	    n++;
+	    x = 0;
+	    in_num = false;
+	    negative = false;
+	}
+	if (c != '\n') {
+	    CHECK(c == ' ' || c == '\t' || c == '\r');
+	} else if (n > 0) {
+	    std::span<const int64_t> nums = (n <= MaxLevels)
+		? std::span<const int64_t>(levels.data(), n)
+		: std::span<const int64_t>(spill);
+	    if (!block.push(nums)) {
+		count += check_report(nums, dampener);
+	    } else if (block.count == BlockLanes) {
+		count += std::popcount(safe_mask(block, dampener));
+		block = ReportBlock();
+	    }
+	    n = 0;
+	}
+    }
+    if (block.count > 0)
+	count += std::popcount(safe_mask(block, dampener));
+    return count;
+}
+
+// The input split at newlines into one chunk per thread
+Answer count_safe_reports_parallel(std::string_view input, bool dampener, size_t n_threads)
 {
-    std::vector<std::vector<int64_t>> num_lines = split_int_lines(input);
-    return std::count_if(num_lines.begin(), num_lines.end(), [](const auto& r){
-	return is_report_safe_2(r);
+    std::vector<std::string_view> chunks = split_view_chunks(input, n_threads);
+    if (chunks.size() <= 1)
+	return count_safe_reports_batched(input, dampener);
+    std::vector<Answer> counts(chunks.size());
+    run_workers(chunks.size(), [&](size_t k) {
+	counts[k] = count_safe_reports_batched(chunks[k], dampener);
     });
+    return std::accumulate(counts.begin(), counts.end(), Answer{0});
 }
 
-void tests()
+Answer part_1(const std::string& input)
 {
-    const char *test_input_1 =
-	"7 6 4 2 1\n"
-	"1 2 7 8 9\n"
-	"9 7 6 2 1\n"
-	"1 3 2 4 5\n"
-	"8 6 4 4 1\n"
-	"1 3 6 7 9\n";
+    return count_safe_reports_parallel(input, false, worker_count(input.size()));
+}
 
-    std::vector<std::vector<int64_t>> num_lines = split_int_lines(test_input_1);
+Answer part_2(const std::string& input)
+{
+    return count_safe_reports_parallel(input, true, worker_count(input.size()));
+}
+
+constexpr const char *test_input_1 =
+    "7 6 4 2 1\n"
+    "1 2 7 8 9\n"
+    "9 7 6 2 1\n"
+    "1 3 2 4 5\n"
+    "8 6 4 4 1\n"
+    "1 3 6 7 9\n";
+
+constexpr bool static_tests()
+{
+    std::vector<std::vector<int64_t>> num_lines = split_view_int_lines(test_input_1);
     CHECK(num_lines.size() == 6);
     CHECK(num_lines[0] == std::vector<int64_t>({7,6,4,2,1}));
     CHECK(compute_diffs(num_lines[0]) == std::vector<int64_t>({-1,-2,-2,-1}));
@@ -97,7 +347,7 @@ void tests()
     CHECK(!is_report_safe(num_lines[3]));
     CHECK(!is_report_safe(num_lines[4]));
     CHECK(is_report_safe(num_lines[5]));
-    CHECK(part_1(test_input_1) == 2);
+    CHECK(count_safe_reports(test_input_1, false) == 2);
 
     //////////////////////////////////////
     CHECK(is_report_safe_2(num_lines[0]));
@@ -106,8 +356,116 @@ void tests()
     CHECK(is_report_safe_2(num_lines[3]));
     CHECK(is_report_safe_2(num_lines[4]));
     CHECK(is_report_safe_2(num_lines[5]));
+    CHECK(count_safe_reports(test_input_1, true) == 4);
+
+    CHECK(split_view_chunks(test_input_1, 1) == std::vector<std::string_view>({test_input_1}));
+    CHECK(split_view_chunks(test_input_1, 3) == std::vector<std::string_view>(
+	      {"7 6 4 2 1\n1 2 7 8 9\n9 7 6 2 1\n", "1 3 2 4 5\n8 6 4 4 1\n", "1 3 6 7 9\n"}));
+    CHECK(split_view_chunks("1 2\n3 4", 8) == std::vector<std::string_view>({"1 2\n", "3 4"}));
+    CHECK(split_view_chunks("", 2).empty());
+
+    CHECK(first_bad_step(num_lines[0], -1) == 5);
+    CHECK(first_bad_step(num_lines[0], 1) == 0);
+    CHECK(first_bad_step(num_lines[3], 1) == 1);
+    for (const std::vector<int64_t>& r : num_lines) {
+	CHECK(is_report_safe_dampened(r) == is_report_safe_2(r));
+    }
+    // Removing the first or last level
+    CHECK(is_report_safe_dampened({9, 1, 2, 3}));
+    CHECK(is_report_safe_dampened({1, 2, 3, 9}));
+    CHECK(is_report_safe_dampened({3, 1, 2, 3}));
+    CHECK(!is_report_safe_dampened({1, 1, 1, 2}));
+
+    for (const std::vector<int64_t>& r : num_lines) {
+	CHECK(is_report_safe_k(r, 0) == is_report_safe(r));
+	CHECK(is_report_safe_k(r, 1) == is_report_safe_2(r));
+    }
+    CHECK(!is_report_safe_k({1, 9, 9, 2, 3}, 1));
+    CHECK(is_report_safe_k({1, 9, 9, 2, 3}, 2));
+    CHECK(is_report_safe_k({9, 9, 9, 9, 1, 2}, 4));
+    CHECK(!is_report_safe_k({9, 9, 9, 9, 1, 2}, 3));
+    CHECK(is_report_safe_k({5, 1, 5, 1, 5, 1, 2}, 5));
+
+    return true;
+}
+
+static_assert(static_tests());
+
+void tests()
+{
+    CHECK(split_int_lines(test_input_1) == split_view_int_lines(test_input_1));
+    CHECK(part_1(test_input_1) == 2);
     CHECK(part_2(test_input_1) == 4);
+
+    // All the reports of 5 levels in [0, 7)
+    std::vector<int64_t> r(5, 0);
+    std::string reports;
+    while (true) {
+	CHECK(is_report_safe_dampened(r) == is_report_safe_2(r));
+	CHECK(is_report_safe_k(r, 0) == is_report_safe(r));
+	CHECK(is_report_safe_k(r, 1) == is_report_safe_2(r));
+	// Against removing one level, then up to one more
+	bool safe = is_report_safe_2(r);
+	for (size_t i_skip = 0; i_skip < r.size(); i_skip++) {
+	    std::vector<int64_t> r_ = r;
+	    r_.erase(r_.begin() + ans(i_skip));
+	    safe = safe || is_report_safe_dampened(r_);
+	}
+	CHECK(is_report_safe_k(r, 2) == safe);
+	for (int64_t x : r)
+	    reports += std::to_string(x) + " ";
+	reports += "\n";
+	size_t i = 0;
+	while (i < r.size() && ++r[i] == 7)
+	    r[i++] = 0;
+	if (i == r.size())
+	    break;
+    }
+    CHECK(count_safe_reports_batched(reports, false) == count_safe_reports(reports, false));
+    CHECK(count_safe_reports_batched(reports, true) == count_safe_reports(reports, true));
+    for (size_t n_threads : {1ul, 2ul, 3ul, 7ul, 64ul}) {
+	CHECK(count_safe_reports_parallel(reports, false, n_threads) == count_safe_reports(reports, false));
+	CHECK(count_safe_reports_parallel(reports, true, n_threads) == count_safe_reports(reports, true));
+    }
+    // Long reports and negative levels, checked one by one
+    CHECK(count_safe_reports_batched("1 2 3 4 5 6 7 8 9 10\n-3 -1 0\n", false) == 2);
+    CHECK(count_safe_reports_batched("1 2 3 4 5 6 7 8 9 10 9\n-3 -1 -1 0", true) == 2);
+
+    // Longer than the parse buffer, and with CRLF
+    std::string long_reports;
+    for (int64_t x = 0; x < 40; x++)
+	long_reports += std::to_string(x == 20 ? 100 : x) + " ";
+    long_reports += "\r\n";
+    for (int64_t x = 0; x < 100; x++)
+	long_reports += std::to_string(2 * x) + " ";
+    long_reports += "\r\n7 6 4 2 1\r\n";
+    CHECK(part_1(long_reports) == 2);
+    CHECK(part_2(long_reports) == 3);
+    CHECK(count_safe_reports_parallel(long_reports, true, 3) == 3);
+
+    bool threw = false;
+    try {
+	part_1("1 2 99999999999999999999\n");
+    } catch (std::runtime_error&) {
+	threw = true;
+    }
+    CHECK(threw);
+
+    ReportBlock block;
+    using Levels = std::vector<int64_t>;
+    CHECK(block.push(Levels{1, 2}));
+    CHECK(block.push(Levels{8, 7, 6, 5, 4, 3, 2, 1}));
+    CHECK(block.push(Levels{1, 5, 6}));
+    CHECK(!block.push(Levels{1}));
+    CHECK(!block.push(Levels{1, 2, 3, 4, 5, 6, 7, 8, 9}));
+    CHECK(!block.push(Levels{1, 200}));
+    CHECK(safe_mask(block, false) == 0b011);
+    CHECK(safe_mask(block, true) == 0b111);
+    // Lanes beyond the size of the report, or the block, are ignored
+    block.levels[3][0] = 100;
+    block.levels[0][5] = 1;
+    block.levels[1][5] = 2;
+    CHECK(safe_mask(block, false) == 0b011);
 }
 
 } //namespace day2
-
@@ -1,15 +1,36 @@
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cstring>
 #include <numeric>
+#include <span>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
 
 #include "common.hpp"
 
 namespace day3 {
 
-std::vector<size_t> find_all_indices(const std::string& input,
-				     const std::string& pattern)
+constexpr std::vector<size_t> find_all_indices(const std::string& input,
+					       const std::string& pattern)
 {
     std::vector<size_t> idx;
     size_t offset = 0;
 
+    if (!std::is_constant_evaluated()) {
+	// Only compare at the offsets where the first byte matches
+	std::string_view head = std::string_view(pattern).substr(0, 1);
+	for (size_t pos : find_all_of(input, head)) {
+	    if (pos >= offset && input.compare(pos, pattern.size(), pattern) == 0) {
+		idx.push_back(pos);
+		offset = pos + pattern.size();
+	    }
+	}
+	return idx;
+    }
+
     while (offset < input.size()) {
 	size_t pos = input.find(pattern, offset);
 	if (pos != std::string::npos) {
@@ -23,7 +44,7 @@ std::vector<size_t> find_all_indices(const std::string& input,
     return idx;
 }
 
-std::vector<std::pair<size_t, size_t>> find_enabled_ranges(const std::string& input)
+constexpr std::vector<std::pair<size_t, size_t>> find_enabled_ranges(const std::string& input)
 {
     std::vector<size_t> i_do = find_all_indices(input, "do()");
     std::vector<size_t> i_dont = find_all_indices(input, "don't()");
@@ -57,17 +78,17 @@ std::vector<std::pair<size_t, size_t>> find_enabled_ranges(const std::string& in
 }
 
 
-std::vector<size_t> find_mul_indices(const std::string& input)
+constexpr std::vector<size_t> find_mul_indices(const std::string& input)
 {
     return find_all_indices(input, "mul(");
 }
 
-std::string leading_digits(const std::string& input, size_t offset)
+constexpr std::string leading_digits(const std::string& input, size_t offset)
 {
     std::string digits;
     for (size_t i = offset; i < input.size(); i++) {
 	char c = input[i];
-	if (std::isdigit(static_cast<unsigned char>(c)))
+	if (c >= '0' && c <= '9')
 	    digits.push_back(c);
 	else
 	    break;
@@ -75,7 +96,7 @@ std::string leading_digits(const std::string& input, size_t offset)
     return digits;
 }
 
-std::optional<int64_t> mul_at(const std::string& input, size_t offset)
+constexpr std::optional<int64_t> mul_at(const std::string& input, size_t offset)
 {
     CHECK(input.substr(offset, 4) == "mul(");
     offset += 4;
@@ -102,10 +123,10 @@ std::optional<int64_t> mul_at(const std::string& input, size_t offset)
 	return {};
 
     // Valid mul!
-    return stoll(str_lhs) * stoll(str_rhs);
+    return parse_int(str_lhs) * parse_int(str_rhs);
 }
 
-std::vector<int64_t> all_muls(const std::string& input)
+constexpr std::vector<int64_t> all_muls(const std::string& input)
 {
     std::vector<int64_t> res;
     for (size_t idx : find_mul_indices(input)) {
@@ -117,7 +138,7 @@ std::vector<int64_t> all_muls(const std::string& input)
     return res;
 }
 
-std::vector<size_t> filter_indices(
+constexpr std::vector<size_t> filter_indices(
     const std::vector<size_t>& all_indices,
     const std::vector<std::pair<size_t, size_t>>& ranges)
 {
@@ -149,7 +170,7 @@ std::vector<size_t> filter_indices(
     return indices;
 }
 
-std::vector<int64_t> all_muls_with_conds(const std::string& input)
+constexpr std::vector<int64_t> all_muls_with_conds(const std::string& input)
 {
     std::vector<std::pair<size_t, size_t>> ranges = find_enabled_ranges(input);
     std::vector<size_t> indices = filter_indices(find_mul_indices(input), ranges);
@@ -165,20 +186,494 @@ std::vector<int64_t> all_muls_with_conds(const std::string& input)
     return res;
 }
 
+constexpr Answer sum_muls(const std::string& input, bool conds)
+{
+    std::vector<int64_t> muls;
+    if (conds)
+	muls = all_muls_with_conds(input);
+    else
+	muls = all_muls(input);
+    return std::accumulate(muls.begin(), muls.end(), Answer{0});
+}
+
+/////////////////////////////////////
+// Single pass scanner
+//
+// The instructions are described by a grammar: each is a name up to its
+// opening parenthesis, a number of comma separated arguments and a
+// closing parenthesis. The grammar is compiled at build time into a DFA
+// over the bytes of the input, with the transitions in a table indexed
+// by state and byte class: a trie of the names, with Aho-Corasick
+// failure transitions so that a byte that breaks a match can start
+// another, followed by a chain of states per instruction for its
+// arguments. The numbers are accumulated as the digits go by, and the
+// enabled state is kept inline, so the sums come out of one pass
+// without any allocation.
+
+enum class Op : uint8_t { Mul, Add, Sub, Enable, Disable };
+
+struct Instruction {
+    // Up to the opening parenthesis, e.g. "mul(", without digits or commas
+    std::string_view name;
+    size_t args;
+    // Per argument, 0 for no limit. Either way an instruction whose
+    // arguments or result don't fit in int64_t is dropped.
+    size_t max_digits;
+    Op op;
+};
+
+constexpr std::array Day3Grammar = {
+    Instruction{"mul(", 2, 0, Op::Mul},
+    Instruction{"do(", 0, 0, Op::Enable},
+    Instruction{"don't(", 0, 0, Op::Disable},
+};
+
+constexpr size_t MaxArgs = 4;
+constexpr size_t MaxStates = 64;
+constexpr size_t MaxClasses = 32;
+constexpr size_t MaxInstructions = 16;
+
+enum Action : uint8_t {
+    NoAction, Begin, Digit, Emit
+};
+
+struct Transition {
+    uint8_t next{0};
+    Action action{NoAction};
+    // The argument for Digit, the instruction for Emit
+    uint8_t arg{0};
+};
+
+// The first bytes of a name, to compare with 4 bytes loaded from memory
+struct NamePrefix {
+    uint32_t word;
+    uint32_t mask;
+};
+
+struct CompiledGrammar {
+    std::array<uint8_t, 256> classes{};
+    size_t n_classes{0};
+    std::array<std::array<Transition, MaxClasses>, MaxStates> table{};
+    size_t n_states{0};
+    // For the states of the trie, the length of the match so far
+    std::array<size_t, MaxStates> depth{};
+    // The bytes that start a name
+    std::array<char, MaxClasses> first_bytes{};
+    size_t n_first_bytes{0};
+    std::array<NamePrefix, MaxInstructions> prefixes{};
+    size_t n_prefixes{0};
+    // No name has a byte that starts a name past its own first one, so
+    // that a scan from the start state anywhere syncs up with a scan of
+    // the whole input at the next instruction
+    bool synchronizing{true};
+};
+
+constexpr CompiledGrammar compile(std::span<const Instruction> grammar)
+{
+    CHECK(grammar.size() <= MaxInstructions);
+    CompiledGrammar g;
+    constexpr uint8_t Other = 0, ByteDigit = 1, ByteComma = 2, ByteClose = 3;
+    for (char c = '0'; c <= '9'; c++)
+	g.classes[static_cast<uint8_t>(c)] = ByteDigit;
+    g.classes[','] = ByteComma;
+    g.classes[')'] = ByteClose;
+    g.n_classes = 4;
+    for (const Instruction& instr : grammar) {
+	CHECK(!instr.name.empty());
+	CHECK(instr.args <= MaxArgs);
+	for (char c : instr.name) {
+	    uint8_t& cls = g.classes[static_cast<uint8_t>(c)];
+	    CHECK(cls != ByteDigit && cls != ByteComma);
+	    if (cls == Other && c != ')') {
+		CHECK(g.n_classes < MaxClasses);
+		cls = static_cast<uint8_t>(g.n_classes++);
+	    }
+	}
+    }
+
+    // The trie of the names, state 0 being the root and start state
+    constexpr int None = -1;
+    std::array<std::array<int, MaxClasses>, MaxStates> child{};
+    for (auto& row : child)
+	row.fill(None);
+    std::array<int, MaxStates> leaf{};
+    leaf.fill(None);
+    g.n_states = 1;
+    for (size_t i = 0; i < grammar.size(); i++) {
+	size_t s = 0;
+	for (char c : grammar[i].name) {
+	    uint8_t cls = g.classes[static_cast<uint8_t>(c)];
+	    if (child[s][cls] == None) {
+		CHECK(g.n_states < MaxStates);
+		g.depth[g.n_states] = g.depth[s] + 1;
+		child[s][cls] = static_cast<int>(g.n_states++);
+	    }
+	    s = static_cast<size_t>(child[s][cls]);
+	}
+	CHECK(leaf[s] == None);
+	leaf[s] = static_cast<int>(i);
+    }
+
+    // Breadth first, so that the failure state of a node is done before it
+    std::array<size_t, MaxStates> queue{};
+    std::array<size_t, MaxStates> failure{};
+    size_t head = 0;
+    size_t tail = 0;
+    queue[tail++] = 0;
+    while (head < tail) {
+	size_t s = queue[head++];
+	for (size_t cls = 0; cls < g.n_classes; cls++) {
+	    size_t fallback = (s == 0) ? 0 : g.table[failure[s]][cls].next;
+	    if (child[s][cls] == None) {
+		g.table[s][cls].next = static_cast<uint8_t>(fallback);
+	    } else {
+		size_t t = static_cast<size_t>(child[s][cls]);
+		g.table[s][cls].next = static_cast<uint8_t>(t);
+		failure[t] = fallback;
+		queue[tail++] = t;
+	    }
+	}
+    }
+
+    // The arguments, from the end of each name. Past the first digit no
+    // name can be in progress, so a byte that breaks a match there is
+    // looked at again from the start state.
+    auto new_state = [&]() {
+	CHECK(g.n_states < MaxStates);
+	g.table[g.n_states] = g.table[0];
+	return g.n_states++;
+    };
+    auto set = [&](size_t s, uint8_t cls, size_t next, Action action, size_t arg) {
+	g.table[s][cls] = {static_cast<uint8_t>(next), action, static_cast<uint8_t>(arg)};
+    };
+    size_t n_trie = g.n_states;
+    for (size_t s = 0; s < n_trie; s++) {
+	if (leaf[s] == None)
+	    continue;
+	size_t i = static_cast<size_t>(leaf[s]);
+	const Instruction& instr = grammar[i];
+	CHECK(child[s][ByteClose] == None);
+	if (instr.args == 0) {
+	    set(s, ByteClose, 0, Emit, i);
+	    continue;
+	}
+	// Expecting the first digit of argument a
+	size_t expect = s;
+	for (size_t a = 0; a < instr.args; a++) {
+	    size_t digits = std::max<size_t>(instr.max_digits, 1);
+	    size_t first = g.n_states;
+	    for (size_t d = 0; d < digits; d++)
+		new_state();
+	    set(expect, ByteDigit, first, Digit, a);
+	    for (size_t d = 0; d + 1 < digits; d++)
+		set(first + d, ByteDigit, first + d + 1, Digit, a);
+	    if (instr.max_digits == 0)
+		set(first, ByteDigit, first, Digit, a);
+	    size_t after = 0;
+	    if (a + 1 < instr.args)
+		after = new_state();
+	    for (size_t d = 0; d < digits; d++) {
+		if (a + 1 < instr.args)
+		    set(first + d, ByteComma, after, NoAction, 0);
+		else
+		    set(first + d, ByteClose, 0, Emit, i);
+	    }
+	    expect = after;
+	}
+    }
+
+    // Entering the end of a name starts an instruction
+    for (size_t s = 0; s < g.n_states; s++) {
+	for (size_t cls = 0; cls < g.n_classes; cls++) {
+	    Transition& t = g.table[s][cls];
+	    if (t.next < n_trie && leaf[t.next] != None && t.action == NoAction)
+		t.action = Begin;
+	}
+    }
+
+    // For the SIMD pre-filter
+    for (size_t c = 0; c < 256; c++) {
+	if (g.table[0][g.classes[c]].next != 0)
+	    g.first_bytes[g.n_first_bytes++] = static_cast<char>(c);
+    }
+    for (const Instruction& instr : grammar) {
+	std::array<char, 4> word{};
+	std::array<uint8_t, 4> mask{};
+	for (size_t k = 0; k < std::min<size_t>(4, instr.name.size()); k++) {
+	    word[k] = instr.name[k];
+	    mask[k] = 0xff;
+	}
+	g.prefixes[g.n_prefixes++] = {std::bit_cast<uint32_t>(word), std::bit_cast<uint32_t>(mask)};
+	for (size_t k = 1; k < instr.name.size(); k++) {
+	    if (g.table[0][g.classes[static_cast<uint8_t>(instr.name[k])]].next != 0)
+		g.synchronizing = false;
+	}
+    }
+    return g;
+}
+
+template <const auto& Grammar>
+struct GrammarScanner {
+    static constexpr CompiledGrammar Compiled = compile(Grammar);
+    static constexpr int64_t Max = std::numeric_limits<int64_t>::max();
+
+    uint8_t state{0};
+    std::array<int64_t, MaxArgs> args{};
+    bool enabled{true};
+    // Of all the instructions, and of the enabled ones only
+    int64_t sum{0};
+    int64_t enabled_sum{0};
+    // Whether a toggle was seen, and the sum of the instructions before
+    // that, which are the ones that depend on the state at the start
+    bool toggled{false};
+    int64_t untoggled_sum{0};
+
+    constexpr void feed(std::string_view bytes) {
+	if (std::is_constant_evaluated()) {
+	    for (char c : bytes)
+		step(c);
+	    return;
+	}
+	// In the start state only the first byte of a name can do
+	// anything, so the bytes in between are skipped 64 at a time with
+	// a SIMD mask
+	constexpr std::string_view first_bytes(Compiled.first_bytes.data(), Compiled.n_first_bytes);
+	uint64_t mask = 0;
+	size_t base = 0;
+	size_t end = 0;
+	for (size_t i = 0; i < bytes.size();) {
+	    if (state != 0) {
+		step(bytes[i++]);
+		continue;
+	    }
+	    if (i >= end) {
+		base = i;
+		end = std::min(bytes.size(), base + 64);
+		mask = byte_mask(bytes.data() + base, end - base, first_bytes);
+	    }
+	    uint64_t candidates = mask & (~0ull << (i - base));
+	    if (candidates == 0) {
+		i = end;
+		continue;
+	    }
+	    i = base + static_cast<size_t>(std::countr_zero(candidates));
+	    // Most candidates don't even start a name
+	    if (i + 4 <= bytes.size() && !starts_name(bytes.data() + i)) {
+		i++;
+		continue;
+	    }
+	    step(bytes[i++]);
+	}
+    }
+
+    // Whether the 4 bytes at p may be the start of a name
+    static bool starts_name(const char *p) {
+	uint32_t word;
+	std::memcpy(&word, p, 4);
+	for (size_t k = 0; k < Compiled.n_prefixes; k++) {
+	    if ((word & Compiled.prefixes[k].mask) == Compiled.prefixes[k].word)
+		return true;
+	}
+	return false;
+    }
+
+    constexpr void step(char c) {
+	Transition t = Compiled.table[state][Compiled.classes[static_cast<uint8_t>(c)]];
+	state = t.next;
+	switch (t.action) {
+	case NoAction:
+	    break;
+	case Begin:
+	    args.fill(0);
+	    break;
+	case Digit:
+	    // An argument that doesn't fit drops the instruction
+	    if (args[t.arg] > (Max - (c - '0')) / 10)
+		state = 0;
+	    else
+		args[t.arg] = args[t.arg] * 10 + (c - '0');
+	    break;
+	case Emit:
+	    apply(Grammar[t.arg]);
+	    break;
+	}
+    }
+
+    constexpr void apply(const Instruction& instr) {
+	int64_t value = 0;
+	switch (instr.op) {
+	case Op::Mul:
+	    value = 1;
+	    for (size_t a = 0; a < instr.args; a++) {
+		if (args[a] != 0 && value > Max / args[a])
+		    return;
+		value *= args[a];
+	    }
+	    break;
+	case Op::Add:
+	    for (size_t a = 0; a < instr.args; a++) {
+		if (value > Max - args[a])
+		    return;
+		value += args[a];
+	    }
+	    break;
+	case Op::Sub:
+	    value = args[0];
+	    for (size_t a = 1; a < instr.args; a++) {
+		if (value < -Max + args[a])
+		    return;
+		value -= args[a];
+	    }
+	    break;
+	case Op::Enable:
+	case Op::Disable:
+	    enabled = (instr.op == Op::Enable);
+	    toggled = true;
+	    return;
+	}
+	sum += value;
+	enabled_sum += enabled ? value : 0;
+	untoggled_sum += toggled ? 0 : value;
+    }
+
+    // Whether the last byte may have started a new instruction
+    constexpr bool at_first_byte() const {
+	return Compiled.depth[state] == 1;
+    }
+};
+
+using Scanner = GrammarScanner<Day3Grammar>;
+
+template <const auto& Grammar = Day3Grammar>
+constexpr GrammarScanner<Grammar> scan(std::string_view input)
+{
+    GrammarScanner<Grammar> scanner;
+    scanner.feed(input);
+    return scanner;
+}
+
+/////////////////////////////////////
+// Parallel mode
+//
+// The input is cut into one chunk per thread, each scanned from the
+// start state and, past its end, up to the end of the instruction in
+// progress there. With a synchronizing grammar, such as that of day 3,
+// a chunk scanned from the start state then sees the same instructions
+// as a scan of the whole input. Each chunk is scanned as if enabled at
+// its start, which also gives the sum as if disabled (less the
+// instructions before its first toggle), and the chunks are then
+// combined in order.
+
+// The scan of a followed by b, with b scanned as if from the start
+template <const auto& Grammar>
+constexpr GrammarScanner<Grammar> combine(const GrammarScanner<Grammar>& a, const GrammarScanner<Grammar>& b)
+{
+    GrammarScanner<Grammar> ab = b;
+    ab.sum = a.sum + b.sum;
+    ab.enabled_sum = a.enabled_sum + b.enabled_sum - (a.enabled ? 0 : b.untoggled_sum);
+    ab.enabled = b.toggled ? b.enabled : a.enabled;
+    ab.toggled = a.toggled || b.toggled;
+    ab.untoggled_sum = a.untoggled_sum + (a.toggled ? 0 : b.untoggled_sum);
+    return ab;
+}
+
+// input[begin, end), and on to the end of the instruction in progress
+template <const auto& Grammar = Day3Grammar>
+constexpr GrammarScanner<Grammar> scan_chunk(std::string_view input, size_t begin, size_t end)
+{
+    static_assert(GrammarScanner<Grammar>::Compiled.synchronizing);
+    GrammarScanner<Grammar> scanner;
+    scanner.feed(input.substr(begin, end - begin));
+    // Back to the start state, or to the first byte of a new instruction
+    for (size_t i = end; i < input.size() && scanner.state != 0; i++) {
+	scanner.feed(input.substr(i, 1));
+	if (scanner.at_first_byte())
+	    break;
+    }
+    return scanner;
+}
+
+template <const auto& Grammar = Day3Grammar>
+GrammarScanner<Grammar> scan_parallel(std::string_view input, size_t n_threads)
+{
+    size_t n = std::min(n_threads, input.size());
+    // Otherwise the chunks can't be scanned independently
+    if constexpr (GrammarScanner<Grammar>::Compiled.synchronizing) {
+	if (n > 1) {
+	    std::vector<GrammarScanner<Grammar>> chunks(n);
+	    run_workers(n, [&](size_t k) {
+		chunks[k] = scan_chunk<Grammar>(input, input.size() * k / n,
+						input.size() * (k + 1) / n);
+	    });
+	    GrammarScanner<Grammar> scanner = chunks[0];
+	    for (size_t k = 1; k < n; k++)
+		scanner = combine(scanner, chunks[k]);
+	    return scanner;
+	}
+    }
+    return scan<Grammar>(input);
+}
+
+/////////////////////////////////////
+// Streaming mode
+//
+// For dumps piped in from other tools: the input is read from a file
+// descriptor in fixed-size chunks, and the scanner state carries the
+// instruction in progress from one chunk to the next (the DFA state and
+// the numbers so far, rather than its bytes), so the memory use is that
+// of the chunk buffer whatever the size of the input.
+
+template <const auto& Grammar = Day3Grammar>
+GrammarScanner<Grammar> scan_fd(int fd, size_t chunk_size = 1 << 16)
+{
+    CHECK(chunk_size > 0);
+#ifdef __linux__
+    std::vector<char> buf(chunk_size);
+    GrammarScanner<Grammar> scanner;
+    while (true) {
+	ssize_t n = read(fd, buf.data(), buf.size());
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n < 0)
+	    throw std::runtime_error(std::string("Unable to read input: ") + std::strerror(errno));
+	if (n == 0)
+	    break;
+	scanner.feed(std::string_view(buf.data(), static_cast<size_t>(n)));
+    }
+    return scanner;
+#else
+    throw std::runtime_error("Streaming input is only supported on Linux");
+#endif
+}
+
 Answer part_1(const std::string& input)
 {
-    std::vector<int64_t> muls = all_muls(input);
-    return std::accumulate(muls.begin(), muls.end(), 0);
+    return scan_parallel(input, worker_count(input.size())).sum;
 }
 
 Answer part_2(const std::string& input)
 {
-    std::vector<int64_t> muls = all_muls_with_conds(input);
-    return std::accumulate(muls.begin(), muls.end(), 0);
+    return scan_parallel(input, worker_count(input.size())).enabled_sum;
 }
 
 
-void tests()
+// Grammars for the tests: extra ops and digit limits, and names that
+// need the failure transitions
+constexpr std::array TestGrammar = {
+    Instruction{"mul(", 2, 3, Op::Mul},
+    Instruction{"add(", 3, 0, Op::Add},
+    Instruction{"sub(", 2, 2, Op::Sub},
+    Instruction{"on(", 0, 0, Op::Enable},
+    Instruction{"off(", 0, 0, Op::Disable},
+};
+
+constexpr std::array OverlapGrammar = {
+    Instruction{"mul(", 2, 0, Op::Mul},
+    Instruction{"ulx(", 1, 0, Op::Add},
+    Instruction{"mmx(", 1, 0, Op::Add},
+};
+
+constexpr bool static_tests()
 {
     CHECK(find_mul_indices("mul(44,46)mul(44,46)") ==
 	  std::vector<size_t>({0,10}));
@@ -197,7 +692,7 @@ void tests()
     std::string ex =
 	"xmul(2,4)%&mul[3,7]!@^do_not_mul(5,5)+mul(32,64]then(mul(11,8)mul(8,5))";
     CHECK(all_muls(ex) == std::vector<int64_t>({2*4,5*5,11*8,8*5}));
-    CHECK(part_1(ex) == 161);
+    CHECK(sum_muls(ex, false) == 161);
 
     ////////////////////////////////////
     
@@ -214,8 +709,129 @@ void tests()
 
     CHECK(all_muls_with_conds(ex) == std::vector<int64_t>({2*4,8*5}));
 
-    CHECK(part_2(ex) == 48);
-    
+    CHECK(sum_muls(ex, true) == 48);
+
+    ////////////////////////////////////
+
+    CHECK(scan(ex).sum == 161);
+    CHECK(scan(ex).enabled_sum == 48);
+    CHECK(scan(bads).sum == 0);
+    CHECK(scan("mmul(2,3)mul(1,mul(4,5)ddo()dodon't()mul(7,1)").sum == 6 + 20 + 7);
+    CHECK(scan("don't()mul(2,3)do()mul(4,5)don't(mul(1,1)").enabled_sum == 21);
+    CHECK(scan("mul(2,3").sum == 0);
+    // Arguments and results that overflow drop the instruction
+    CHECK(scan("mul(99999999999999999999999,2)mul(2,3)").sum == 6);
+    CHECK(scan("mul(9999999999,9999999999)mul(1,2)").sum == 2);
+    CHECK(scan("mul(9223372036854775807,1)").sum == std::numeric_limits<int64_t>::max());
+    CHECK(scan("mul(9223372036854775808,1)mul(4,1)").sum == 4);
+    // Incomplete instructions carry over to the next call
+    Scanner scanner;
+    scanner.feed("mul(12");
+    scanner.feed("3,2)don'");
+    scanner.feed("t()mul(1,1)");
+    CHECK(scanner.sum == 247);
+    CHECK(scanner.enabled_sum == 246);
+
+    ////////////////////////////////////
+
+    CHECK(Scanner::Compiled.synchronizing);
+    CHECK(Scanner::Compiled.n_first_bytes == 2);
+
+    auto t = scan<TestGrammar>("mul(1234,5)mul(123,4)add(1,2,3)add(1,2)sub(10,3)sub(100,1)"
+			       "off()mul(2,2)on()add(1,1,1)do()");
+    CHECK(t.sum == 492 + 6 + 7 + 4 + 3);
+    CHECK(t.enabled_sum == 492 + 6 + 7 + 3);
+    CHECK(GrammarScanner<TestGrammar>::Compiled.synchronizing);
+    CHECK(scan<TestGrammar>("add(9223372036854775807,1,0)add(1,2,3)").sum == 6);
+
+    auto o = scan<OverlapGrammar>("mulx(5)mmul(2,3)mmmx(7)mmulx(1)");
+    CHECK(o.sum == 5 + 6 + 7 + 1);
+    CHECK(!GrammarScanner<OverlapGrammar>::Compiled.synchronizing);
+
+    // Cut at every byte
+    std::string_view toggles = "mul(2,3)don't()mul(1,1)mmul(7,1)do()mul(4,4)ddon't()mul(5,5)";
+    for (size_t i = 0; i <= toggles.size(); i++) {
+	Scanner s = combine(scan_chunk(toggles, 0, i), scan_chunk(toggles, i, toggles.size()));
+	CHECK(s.sum == scan(toggles).sum);
+	CHECK(s.enabled_sum == scan(toggles).enabled_sum);
+    }
+    CHECK(combine(scan("don't()mul(1,1)"), scan("mul(2,2)do()mul(3,3)")).enabled_sum == 9);
+    CHECK(combine(scan("don't()do()"), scan("mul(2,2)")).enabled_sum == 4);
+
+    return true;
+}
+
+static_assert(static_tests());
+
+void tests()
+{
+    CHECK(find_all_indices("mul(44,46)mul(44,46)", "mul(") ==
+	  std::vector<size_t>({0,10}));
+    CHECK(find_all_of("xmul(2,4)do()", "d(") == std::vector<size_t>({4,9,11}));
+    CHECK(part_1("xmul(2,4)%&mul[3,7]!@^do_not_mul(5,5)+mul(32,64]then(mul(11,8)mul(8,5))") == 161);
+    CHECK(part_2("xmul(2,4)&mul[3,7]!^don't()_mul(5,5)+mul(32,64](mul(11,8)undo()?mul(8,5))") == 48);
+
+    // Against the multi-pass version, on noise made of the instructions' bytes
+    std::string noise = "x";
+    const std::string_view bytes = "mul(dont')0123456789,x";
+    uint64_t seed = 1;
+    for (size_t i = 0; i < 100000; i++) {
+	seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+	noise.push_back(bytes[(seed >> 33) % bytes.size()]);
+	if (i % 97 == 0)
+	    noise += (i % 2) ? "do()" : "don't()";
+	if (i % 31 == 0)
+	    noise += "mul(" + std::to_string(i % 1000) + "," + std::to_string(i % 7) + ")";
+    }
+    CHECK(scan(noise).sum == sum_muls(noise, false));
+    CHECK(scan(noise).enabled_sum == sum_muls(noise, true));
+    // Sums past 32 bits
+    std::string large = "x";
+    for (size_t i = 0; i < 3000; i++)
+	large += "mul(999,999)";
+    large += "don't()mul(1,1)do()";
+    CHECK(sum_muls(large, false) == Answer{3000} * 999 * 999 + 1);
+    CHECK(scan(large).sum == sum_muls(large, false));
+    CHECK(scan(large).enabled_sum == sum_muls(large, true));
+    for (size_t n_threads : {2ul, 3ul, 16ul, 100ul}) {
+	CHECK(scan_parallel(noise, n_threads).sum == scan(noise).sum);
+	CHECK(scan_parallel(noise, n_threads).enabled_sum == scan(noise).enabled_sum);
+    }
+    CHECK(scan_parallel("mul(2,3)don't()mul(1,1)do()mul(4,4)", 64).enabled_sum == 22);
+    std::string ops;
+    for (size_t i = 0; i < 1000; i++)
+	ops += "xadd(1,2," + std::to_string(i) + ")sub(9,1)mul(1000,2)" + ((i % 3) ? "on()" : "off()");
+    CHECK(scan_parallel<TestGrammar>(ops, 7).enabled_sum == scan<TestGrammar>(ops).enabled_sum);
+    CHECK(scan_parallel<OverlapGrammar>(noise, 7).sum == scan<OverlapGrammar>(noise).sum);
+
+    // Instructions across the 64 byte blocks of the candidate mask
+    for (size_t pad = 0; pad < 140; pad++) {
+	std::string padded = std::string(pad, 'x') + "mul(12,34)" + std::string(pad % 67, '(')
+	    + "don't()mul(5,6)" + std::string(pad, ')') + "do()mul(1,2)";
+	Scanner s = scan(padded);
+	CHECK(s.sum == 408 + 30 + 2);
+	CHECK(s.enabled_sum == 408 + 2);
+    }
+
+#ifdef __linux__
+    // From a pipe, in chunks smaller than an instruction
+    for (size_t chunk_size : {1ul, 5ul, 12ul, 4096ul}) {
+	int fds[2];
+	CHECK(pipe(fds) == 0);
+	std::thread writer([&]() {
+	    for (size_t i = 0; i < noise.size(); i += 1000) {
+		std::string_view piece = std::string_view(noise).substr(i, 1000);
+		CHECK(write(fds[1], piece.data(), piece.size()) == ans(piece.size()));
+	    }
+	    close(fds[1]);
+	});
+	Scanner s = scan_fd(fds[0], chunk_size);
+	writer.join();
+	close(fds[0]);
+	CHECK(s.sum == scan(noise).sum);
+	CHECK(s.enabled_sum == scan(noise).enabled_sum);
+    }
+#endif
 }
 
 } //namespace day3
@@ -1,5 +1,12 @@
+#include <array>
+#include <bit>
+#include <numeric>
 #include <unordered_map>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "common.hpp"
 
 namespace day4 {
@@ -265,35 +272,437 @@ size_t x_mas_at(size_t i, size_t j, const Grid& grid)
 }
 
 
-Answer part_1(const std::string& input)
+size_t count_xmas_cells(const std::string& input)
 {
     std::vector<std::string> lines = split_lines(input);
     Grid grid(lines.size(), lines[0].size());
     grid.insert(lines);
 
+    // Only the X and S cells can start a match
     size_t n = 0;
-    for (size_t i = 0; i < grid.rows(); i++) {	
-	for (size_t j = 0; j < grid.cols(); j++) {
-	    n += xmas_at(i, j, grid);
+    for (auto [i, j] : find_cells(input, "XS")) {
+	n += xmas_at(i, j, grid);
+    }
+    return n;
+}
+
+/////////////////////////////////////
+// Bitboard engine
+//
+// One bitplane per letter of XMAS, with bit j of word w of a row set if
+// cell (i, 64 w + j) holds that letter. A match in a given direction
+// starting at the cells of a word is then the AND of the word of the X
+// plane with the words of the M, A and S planes of the next rows,
+// shifted by the column offset, so 64 cells are checked at once.
+
+constexpr std::string_view Letters = "XMAS";
+
+// The bits of the cells of line that hold letter k, 64 per word
+void pack_row(std::string_view line, size_t k, uint64_t *out)
+{
+    for (size_t w = 0; 64 * w < line.size(); w++) {
+	size_t n = std::min<size_t>(64, line.size() - 64 * w);
+	out[w] = byte_mask(line.data() + 64 * w, n, Letters.substr(k, 1));
+    }
+}
+
+// Word w of a packed row, shifted so that its bit j is that of column
+// 64 w + j + dj
+uint64_t shifted_word(const uint64_t *row, size_t words, size_t w, int dj)
+{
+    if (dj == 0)
+	return row[w];
+    if (dj > 0) {
+	uint64_t next = (w + 1 < words) ? row[w + 1] : 0;
+	return (row[w] >> dj) | (next << (64 - dj));
+    }
+    uint64_t prev = (w > 0) ? row[w - 1] : 0;
+    return (row[w] << -dj) | (prev >> (64 + dj));
+}
+
+class Bitplanes {
+public:
+    explicit Bitplanes(std::string_view input)
+	: Bitplanes(split_view_lines(input)) {}
+
+    explicit Bitplanes(const std::vector<std::string_view>& lines) {
+	CHECK(!lines.empty());
+	m_rows = lines.size();
+	m_cols = lines[0].size();
+	m_words = (m_cols + 63) / 64;
+	m_bits.resize(Letters.size() * m_rows * m_words);
+	for (size_t i = 0; i < m_rows; i++) {
+	    CHECK(lines[i].size() == m_cols);
+	    for (size_t k = 0; k < Letters.size(); k++)
+		pack_row(lines[i], k, &m_bits[idx(k, i, 0)]);
+	}
+    }
+
+    size_t rows() const { return m_rows; }
+    size_t cols() const { return m_cols; }
+    size_t words() const { return m_words; }
+
+    // Word w of row i of the plane of letter k, shifted so that its bit j
+    // is that of cell (i, 64 w + j + dj)
+    uint64_t word(size_t k, size_t i, size_t w, int dj) const {
+	return shifted_word(&m_bits[idx(k, i, 0)], m_words, w, dj);
+    }
+
+private:
+    size_t idx(size_t k, size_t i, size_t w) const {
+	return (k * m_rows + i) * m_words + w;
+    }
+
+    size_t m_rows;
+    size_t m_cols;
+    size_t m_words;
+    std::vector<uint64_t> m_bits;
+};
+
+// XMAS and SAMX, right, down and along both diagonals, from the rows in
+// [row_begin, row_end) and down to 3 rows past it, over Bitplanes or a
+// BitplaneRing
+template <typename Planes>
+size_t count_xmas(const Planes& planes, size_t row_begin, size_t row_end)
+{
+    constexpr std::array<std::pair<size_t, int>, 4> directions = {{{0, 1}, {1, 0}, {1, 1}, {1, -1}}};
+    size_t n = 0;
+    for (size_t i = row_begin; i < row_end; i++) {
+	for (auto [di, dj] : directions) {
+	    if (i + 3 * di >= planes.rows())
+		continue;
+	    for (size_t w = 0; w < planes.words(); w++) {
+		uint64_t fwd = ~0ull;
+		uint64_t bwd = ~0ull;
+		for (size_t k = 0; k < 4; k++) {
+		    int dk = static_cast<int>(k) * dj;
+		    fwd &= planes.word(k, i + k * di, w, dk);
+		    bwd &= planes.word(3 - k, i + k * di, w, dk);
+		}
+		n += static_cast<size_t>(std::popcount(fwd) + std::popcount(bwd));
+	    }
 	}
     }
-    return ans(n);
+    return n;
 }
 
-Answer part_2(const std::string& input)
+size_t count_xmas(const Bitplanes& planes)
 {
-    std::vector<std::string> lines = split_lines(input);
-    Grid grid(lines.size(), lines[0].size());
-    grid.insert(lines);
+    return count_xmas(planes, 0, planes.rows());
+}
+
+/////////////////////////////////////
+// Multi-pattern search
+//
+// An Aho-Corasick automaton over the words and their reverses, run once
+// along every row, column and diagonal: matches of a reversed word are
+// those of the word in the opposite direction. The automaton only counts
+// the visits to its states; the matches of a word are then the visits
+// to the states whose failure chain leads to the end of the word.
+
+class WordSearch {
+public:
+    explicit WordSearch(const std::vector<std::string>& words)
+	: m_n_words{words.size()} {
+	m_classes.fill(0);
+	for (const std::string& word : words) {
+	    CHECK(!word.empty());
+	    for (char c : word) {
+		uint8_t& cls = m_classes[static_cast<uint8_t>(c)];
+		if (cls == 0) {
+		    CHECK(m_n_classes < 256);
+		    cls = static_cast<uint8_t>(m_n_classes++);
+		}
+	    }
+	}
+	new_node();
+	for (size_t k = 0; k < words.size(); k++) {
+	    m_ends.emplace_back(insert(words[k]), k);
+	    m_ends.emplace_back(insert(std::string(words[k].rbegin(), words[k].rend())), k);
+	}
+	build_failures();
+    }
+
+    // The occurrences of each word, in all 8 directions
+    std::vector<size_t> count(std::string_view input) const {
+	std::vector<std::string_view> lines = split_view_lines(input);
+	CHECK(!lines.empty());
+	int64_t rows = ans(lines.size());
+	int64_t cols = ans(lines[0].size());
+	for (std::string_view line : lines)
+	    CHECK(ans(line.size()) == cols);
+
+	std::vector<size_t> visits(m_fail.size());
+	auto scan = [&](int64_t i, int64_t j, int64_t di, int64_t dj) {
+	    size_t s = 0;
+	    for (; i >= 0 && i < rows && j >= 0 && j < cols; i += di, j += dj) {
+		s = next(s, lines[static_cast<size_t>(i)][static_cast<size_t>(j)]);
+		visits[s]++;
+	    }
+	};
+	for (int64_t i = 0; i < rows; i++) {
+	    scan(i, 0, 0, 1);
+	    scan(i, 0, 1, 1);
+	    scan(i, cols - 1, 1, -1);
+	}
+	for (int64_t j = 0; j < cols; j++) {
+	    scan(0, j, 1, 0);
+	    if (j > 0)
+		scan(0, j, 1, 1);
+	    if (j < cols - 1)
+		scan(0, j, 1, -1);
+	}
+
+	// Deepest first, so that visits add up along the failure chains
+	for (size_t k = m_order.size(); k-- > 1;)
+	    visits[m_fail[m_order[k]]] += visits[m_order[k]];
+	std::vector<size_t> counts(m_n_words);
+	for (auto [node, k] : m_ends)
+	    counts[k] += visits[node];
+	return counts;
+    }
+
+private:
+    size_t next(size_t s, char c) const {
+	return m_next[s * m_n_classes + m_classes[static_cast<uint8_t>(c)]];
+    }
+
+    size_t new_node() {
+	m_next.resize(m_next.size() + m_n_classes, None);
+	m_fail.push_back(0);
+	return m_fail.size() - 1;
+    }
+
+    size_t insert(const std::string& word) {
+	size_t s = 0;
+	for (char c : word) {
+	    size_t t = s * m_n_classes + m_classes[static_cast<uint8_t>(c)];
+	    if (m_next[t] == None) {
+		size_t n = new_node();
+		m_next[t] = n;
+	    }
+	    s = m_next[t];
+	}
+	return s;
+    }
+
+    // Also turns the trie into the full transition table, breadth first
+    void build_failures() {
+	m_order.push_back(0);
+	for (size_t head = 0; head < m_order.size(); head++) {
+	    size_t s = m_order[head];
+	    for (size_t cls = 0; cls < m_n_classes; cls++) {
+		size_t fallback = (s == 0) ? 0 : m_next[m_fail[s] * m_n_classes + cls];
+		size_t& t = m_next[s * m_n_classes + cls];
+		if (t == None) {
+		    t = fallback;
+		} else {
+		    m_fail[t] = fallback;
+		    m_order.push_back(t);
+		}
+	    }
+	}
+    }
+
+    static constexpr size_t None = std::numeric_limits<size_t>::max();
+
+    size_t m_n_words;
+    std::array<uint8_t, 256> m_classes;
+    // Class 0 is for the bytes in none of the words
+    size_t m_n_classes{1};
+    std::vector<size_t> m_next;
+    std::vector<size_t> m_fail;
+    // The states in breadth first order
+    std::vector<size_t> m_order;
+    // The state at the end of each word and its reverse
+    std::vector<std::pair<size_t, size_t>> m_ends;
+};
 
+// The X-MAS centered on the rows in [row_begin, row_end), with the row
+// above and below
+size_t count_x_mas(std::string_view input, const Grid& grid, size_t row_begin, size_t row_end)
+{
+    size_t line = grid.cols() + 1;
+    std::string_view band = input.substr(std::min(input.size(), row_begin * line),
+					 (row_end - row_begin) * line);
     size_t n = 0;
-    for (size_t i = 0; i < grid.rows(); i++) {	
-	for (size_t j = 0; j < grid.cols(); j++) {
-	    if (x_mas_at(i, j, grid))
-		n++;
+    for (auto [i, j] : find_cells(band, "A")) {
+	if (x_mas_at(row_begin + i, j, grid))
+	    n++;
+    }
+    return n;
+}
+
+/////////////////////////////////////
+// X-MAS kernel
+//
+// The four corners of the X-MAS centered on cells (i, j) to (i, j + 15)
+// are 16 byte loads from rows i - 1 and i + 1, one column to the left
+// and right, so whole row segments are checked with byte compares.
+
+// Bit t is set if cell (i, j + t) is the center of an X-MAS, for t < n
+// <= 64, from rows i - 1, i and i + 1, with 1 <= j and j + n < columns
+uint64_t x_mas_mask(const char *up, const char *mid, const char *down, size_t j, size_t n)
+{
+    CHECK(n <= 64 && j >= 1);
+    uint64_t mask = 0;
+    size_t t = 0;
+#ifdef __SSE2__
+    auto load = [](const char *p) {
+	return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    };
+    const __m128i m = _mm_set1_epi8('M');
+    const __m128i s = _mm_set1_epi8('S');
+    // Either M and S or S and M
+    auto ms_vec = [&](__m128i x, __m128i y) {
+	return _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi8(x, m), _mm_cmpeq_epi8(y, s)),
+			    _mm_and_si128(_mm_cmpeq_epi8(x, s), _mm_cmpeq_epi8(y, m)));
+    };
+    for (; t + 16 <= n; t += 16) {
+	size_t c = j + t;
+	__m128i a = _mm_cmpeq_epi8(load(mid + c), _mm_set1_epi8('A'));
+	__m128i d1 = ms_vec(load(up + c - 1), load(down + c + 1));
+	__m128i d2 = ms_vec(load(up + c + 1), load(down + c - 1));
+	__m128i x = _mm_and_si128(a, _mm_and_si128(d1, d2));
+	mask |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(x))) << t;
+    }
+#endif
+    auto ms = [](char x, char y) {
+	return (x == 'M' && y == 'S') || (x == 'S' && y == 'M');
+    };
+    for (; t < n; t++) {
+	size_t c = j + t;
+	if (mid[c] == 'A' && ms(up[c - 1], down[c + 1]) && ms(up[c + 1], down[c - 1]))
+	    mask |= 1ull << t;
+    }
+    return mask;
+}
+
+// The X-MAS centered on row mid
+size_t count_x_mas(std::string_view up, std::string_view mid, std::string_view down)
+{
+    size_t n = 0;
+    for (size_t j = 1; j + 1 < mid.size(); j += 64) {
+	uint64_t mask = x_mas_mask(up.data(), mid.data(), down.data(),
+				   j, std::min<size_t>(64, mid.size() - 1 - j));
+	n += static_cast<size_t>(std::popcount(mask));
+    }
+    return n;
+}
+
+size_t count_x_mas(const std::vector<std::string_view>& rows, size_t row_begin, size_t row_end)
+{
+    size_t n = 0;
+    for (size_t i = std::max<size_t>(row_begin, 1); i < std::min(row_end, rows.size() - 1); i++)
+	n += count_x_mas(rows[i - 1], rows[i], rows[i + 1]);
+    return n;
+}
+
+/////////////////////////////////////
+// Parallel mode
+//
+// The rows are split into one horizontal band per thread. A band counts
+// the matches whose top row (for X-MAS, center row) is one of its own,
+// reading up to 3 rows past it, so each match is counted exactly once.
+
+template <typename F>
+size_t count_bands(size_t rows, size_t n_threads, F count)
+{
+    size_t n = std::min(n_threads, rows);
+    if (n <= 1)
+	return count(0, rows);
+    std::vector<size_t> counts(n);
+    run_workers(n, [&](size_t k) {
+	counts[k] = count(rows * k / n, rows * (k + 1) / n);
+    });
+    return std::accumulate(counts.begin(), counts.end(), size_t{0});
+}
+
+Answer part_1(const std::string& input)
+{
+    Bitplanes planes(input);
+    return ans(count_bands(planes.rows(), worker_count(input.size()), [&](size_t begin, size_t end) {
+	return count_xmas(planes, begin, end);
+    }));
+}
+
+Answer part_2(const std::string& input)
+{
+    std::vector<std::string_view> rows = split_view_lines(input);
+    CHECK(!rows.empty());
+    for (std::string_view row : rows)
+	CHECK(row.size() == rows[0].size());
+    return ans(count_bands(rows.size(), worker_count(input.size()), [&](size_t begin, size_t end) {
+	return count_x_mas(rows, begin, end);
+    }));
+}
+
+/////////////////////////////////////
+// Streaming mode
+//
+// For very tall grids: the rows are read one at a time into a ring
+// buffer of the last 4, each one packed into bitplanes once as it comes
+// in. The XMAS with their top row 3 rows up and the X-MAS centered on
+// the row above are then counted on that window, so the memory use is
+// O(width).
+
+// The bitplanes of the last 4 rows pushed, oldest first
+class BitplaneRing {
+public:
+    void push(std::string_view line) {
+	if (m_pushed == 0) {
+	    m_cols = line.size();
+	    m_words = (m_cols + 63) / 64;
+	    m_bits.resize(Letters.size() * 4 * m_words);
 	}
+	CHECK(line.size() == m_cols);
+	for (size_t k = 0; k < Letters.size(); k++)
+	    pack_row(line, k, &m_bits[idx(k, m_pushed % 4, 0)]);
+	m_pushed++;
+    }
+
+    size_t rows() const { return std::min<size_t>(m_pushed, 4); }
+    size_t words() const { return m_words; }
+
+    uint64_t word(size_t k, size_t i, size_t w, int dj) const {
+	return shifted_word(&m_bits[idx(k, (m_pushed - rows() + i) % 4, 0)], m_words, w, dj);
+    }
+
+private:
+    size_t idx(size_t k, size_t slot, size_t w) const {
+	return (k * 4 + slot) * m_words + w;
     }
-    return ans(n);
+
+    size_t m_pushed{0};
+    size_t m_cols{0};
+    size_t m_words{0};
+    std::vector<uint64_t> m_bits;
+};
+
+struct Counts {
+    size_t xmas;
+    size_t x_mas;
+};
+
+Counts stream_counts(std::istream& stream)
+{
+    BitplaneRing planes;
+    std::array<std::string, 4> lines;
+    size_t r = 0;
+
+    Counts counts{0, 0};
+    while (std::getline(stream, lines[r % 4])) {
+	planes.push(lines[r % 4]);
+	r++;
+	if (r >= 4)
+	    counts.xmas += count_xmas(planes, 0, 1);
+	if (r >= 3)
+	    counts.x_mas += count_x_mas(lines[(r - 3) % 4], lines[(r - 2) % 4], lines[(r - 1) % 4]);
+    }
+    // From the last rows, where no match fits vertically
+    size_t n = std::min<size_t>(r, 3);
+    counts.xmas += count_xmas(planes, planes.rows() - n, planes.rows());
+    return counts;
 }
 
 void tests()
@@ -331,12 +740,120 @@ void tests()
     CHECK(xmas_at(6, 9, grid) == 1);
     CHECK(xmas_at(9, 5, grid) == 1);
 
+    CHECK(find_cells(test_input_1, "X").front() == std::make_pair(0ul, 4ul));
     CHECK(part_1(test_input_1) == 18);
+    CHECK(count_xmas_cells(test_input_1) == 18);
+
+    Bitplanes planes(test_input_1);
+    CHECK(planes.rows() == 10 && planes.cols() == 10 && planes.words() == 1);
+    CHECK(planes.word(0, 0, 0, 0) == 0b110000);
+    CHECK(planes.word(0, 0, 0, 4) == 0b11);
+    CHECK(planes.word(3, 0, 0, -1) == 0b1000010000);
+
+    // Wider than a word, against the cell by cell count
+    std::string big;
+    uint64_t seed = 1;
+    for (size_t i = 0; i < 40; i++) {
+	for (size_t j = 0; j < 150; j++) {
+	    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+	    big.push_back(Letters[(seed >> 33) % 4]);
+	}
+	big.push_back('\n');
+    }
+    CHECK(count_xmas(Bitplanes(big)) == count_xmas_cells(big));
+
+    /////////////////////////////
+
+    CHECK(WordSearch({"XMAS"}).count(test_input_1) == std::vector<size_t>({18}));
+
+    // Against checking every cell in every direction
+    std::vector<std::string> words = {"XMAS", "MAS", "AMA", "S", "SAMXMAS", "XX", "MAS"};
+    std::vector<std::string> rows = split_lines(big);
+    std::vector<size_t> counts(words.size());
+    for (size_t k = 0; k < words.size(); k++) {
+	for (int64_t i = 0; i < ans(rows.size()); i++) {
+	    for (int64_t j = 0; j < ans(rows[0].size()); j++) {
+		for (int64_t di : {-1, 0, 1}) {
+		    for (int64_t dj : {-1, 0, 1}) {
+			if (di == 0 && dj == 0)
+			    continue;
+			size_t n = 0;
+			for (int64_t y = i, x = j; n < words[k].size(); y += di, x += dj, n++) {
+			    if (y < 0 || y >= ans(rows.size()) || x < 0 || x >= ans(rows[0].size()))
+				break;
+			    if (rows[static_cast<size_t>(y)][static_cast<size_t>(x)] != words[k][n])
+				break;
+			}
+			counts[k] += (n == words[k].size());
+		    }
+		}
+	    }
+	}
+    }
+    CHECK(WordSearch(words).count(big) == counts);
+    CHECK(counts[3] == 8 * static_cast<size_t>(std::count(big.begin(), big.end(), 'S')));
 
     /////////////////////////////
 
     CHECK(x_mas_at(1, 2, grid));
     CHECK(part_2(test_input_1) == 9);
+
+    /////////////////////////////
+
+    // Down to bands of a single row
+    Bitplanes big_planes(big);
+    lines = split_lines(big);
+    Grid big_grid(lines.size(), lines[0].size());
+    big_grid.insert(lines);
+    size_t n_x_mas = count_x_mas(big, big_grid, 0, big_grid.rows());
+    std::vector<std::string_view> big_rows = split_view_lines(big);
+    CHECK(count_x_mas(big_rows, 0, big_rows.size()) == n_x_mas);
+    // Segments shorter than a vector, and at the right edge
+    for (size_t cols = 3; cols < 40; cols++) {
+	std::vector<std::string_view> narrow;
+	for (std::string_view row : big_rows)
+	    narrow.push_back(row.substr(0, cols));
+	std::string narrow_input;
+	for (std::string_view row : narrow)
+	    narrow_input += std::string(row) + "\n";
+	lines = split_lines(narrow_input);
+	Grid narrow_grid(lines.size(), lines[0].size());
+	narrow_grid.insert(lines);
+	CHECK(count_x_mas(narrow, 0, narrow.size())
+	      == count_x_mas(narrow_input, narrow_grid, 0, narrow_grid.rows()));
+    }
+    for (size_t n_threads : {2ul, 3ul, 7ul, 40ul, 64ul}) {
+	CHECK(count_bands(big_planes.rows(), n_threads, [&](size_t begin, size_t end) {
+	    return count_xmas(big_planes, begin, end);
+	}) == count_xmas_cells(big));
+	CHECK(count_bands(big_grid.rows(), n_threads, [&](size_t begin, size_t end) {
+	    return count_x_mas(big, big_grid, begin, end);
+	}) == n_x_mas);
+	CHECK(count_bands(big_rows.size(), n_threads, [&](size_t begin, size_t end) {
+	    return count_x_mas(big_rows, begin, end);
+	}) == n_x_mas);
+    }
+
+    /////////////////////////////
+
+    std::stringstream stream(test_input_1);
+    Counts streamed = stream_counts(stream);
+    CHECK(streamed.xmas == 18);
+    CHECK(streamed.x_mas == 9);
+
+    stream = std::stringstream(big);
+    streamed = stream_counts(stream);
+    CHECK(streamed.xmas == count_xmas_cells(big));
+    CHECK(streamed.x_mas == n_x_mas);
+
+    // Fewer rows than the window
+    for (auto [few, xmas, x_mas] : std::vector<std::tuple<std::string, size_t, size_t>>{
+	    {"", 0, 0}, {"XMAS", 1, 0}, {"SAMXMAS\nMMMMMMM", 2, 0}, {"MXS\nXAX\nMXS\n", 0, 1}}) {
+	stream = std::stringstream(few);
+	streamed = stream_counts(stream);
+	CHECK(streamed.xmas == xmas);
+	CHECK(streamed.x_mas == x_mas);
+    }
 }
 
 } //namespace day4
@@ -36,17 +36,13 @@ InputData read_input_data(const std::string& str)
     data.bounds = std::make_pair(ans(lines.size()), ans(lines[0].size()));
     for (size_t i = 0; i < lines.size(); i++) {
 	CHECK(ans(lines[i].size()) == data.bounds.second);
-	for (size_t j = 0; j < lines[i].size(); j++) {
-	    switch (lines[i][j]) {
-	    case '^':
-		data.startpos = std::make_pair(i, j);
-		continue;
-	    case '#':
-		data.add_obstacle(i, j);
-		continue;
-	    }
-	}
     }
+    for (auto [i, j] : find_cells(str, "#")) {
+	data.add_obstacle(i, j);
+    }
+    std::vector<std::pair<size_t, size_t>> start = find_cells(str, "^");
+    CHECK(start.size() == 1);
+    data.startpos = start.front();
     return data;
 }
     
@@ -161,6 +157,8 @@ void tests()
     CHECK(!data.out_of_bounds(5,5));
     CHECK(data.startpos.first == 6);
     CHECK(data.startpos.second == 4);
+    CHECK(find_cells(test_input_1, "#").size() == 8);
+    CHECK(find_cells(test_input_1, "#^", true).size() == 100 - 9);
 
     int64_t i = 0;
     int64_t j = 1;
@@ -10,29 +10,34 @@ struct InputData {
     std::vector<uint64_t> operands;
 };
 
-std::vector<InputData> read_input_data(const std::string& input)
+constexpr std::vector<InputData> read_input_data(std::string_view input)
 {
     std::vector<InputData> retv;
-    std::vector<std::string> lines = split_lines(input);    
-    for (const std::string& line : lines) {
+    for (std::string_view line : split_view_lines(input)) {
 	InputData data;
-	std::vector<std::string> fields = split_at(line, ':');
+	std::vector<std::string_view> fields = split_view_at(line, ':');
 	CHECK(fields.size() == 2);
-	data.result = stoull(fields[0]);
-	std::vector<std::string> numstrs = split_at(fields[1], ' ');
-	std::transform(numstrs.begin(), numstrs.end(),
-		       std::back_inserter(data.operands),
-		       [](auto s){return stoull(s);});
+	data.result = static_cast<uint64_t>(parse_int(fields[0]));
+	for (std::string_view numstr : split_view_at(fields[1], ' '))
+	    data.operands.push_back(static_cast<uint64_t>(parse_int(numstr)));
 	retv.push_back(std::move(data));
     }
 
     return retv;
 }
 
+constexpr uint64_t concatenate(uint64_t lhs, uint64_t rhs)
+{
+    uint64_t shift = 10;
+    while (shift <= rhs)
+	shift *= 10;
+    return lhs * shift + rhs;
+}
+
 enum Operator { Add, Mul, Concat };
 enum Result {Low, Equal, High};
 
-Result eval(const InputData& data, const std::vector<Operator>& operators)
+constexpr Result eval(const InputData& data, const std::vector<Operator>& operators)
 {
     CHECK(data.operands.size() >= 2);
     CHECK(operators.size() == data.operands.size() - 1);
@@ -48,7 +53,7 @@ Result eval(const InputData& data, const std::vector<Operator>& operators)
 	    acc = acc * data.operands[i];
 	    break;
 	case Concat:
-	    acc = stoull(std::to_string(acc) + std::to_string(data.operands[i]));
+	    acc = concatenate(acc, data.operands[i]);
 	    break;
 	}
     }
@@ -60,15 +65,15 @@ Result eval(const InputData& data, const std::vector<Operator>& operators)
     return Equal;
 }
 
-bool produced_by(const InputData& data, const std::vector<Operator>& operators)
+constexpr bool produced_by(const InputData& data, const std::vector<Operator>& operators)
 {
     return eval(data, operators) == Equal;
 }
 
-bool is_valid_data(const InputData& data,
-		   std::vector<Operator>& operators,
-		   size_t i,
-		   bool concat = false)
+constexpr bool is_valid_data(const InputData& data,
+			     std::vector<Operator>& operators,
+			     size_t i,
+			     bool concat = false)
 {
     if (i == operators.size()) {
 	return produced_by(data, operators);
@@ -91,7 +96,7 @@ bool is_valid_data(const InputData& data,
     return false;
 }
 
-bool is_valid_data(const InputData& data, bool concat = false)
+constexpr bool is_valid_data(const InputData& data, bool concat = false)
 {
     std::vector<Operator> operators(data.operands.size() - 1, Operator::Mul);
     return is_valid_data(data, operators, 0, concat);
@@ -155,48 +160,43 @@ void checker_part1(int trials = 100000)
 }
 
 
-Answer part_1(const std::string& input)
+constexpr uint64_t total_calibration(std::string_view input, bool concat)
 {
     std::vector<InputData> data = read_input_data(input);
-    uint64_t acc = std::accumulate(data.begin(), data.end(), 0ull,
-			   [](uint64_t a, const InputData& d){
-			       if (is_valid_data(d))
+    return std::accumulate(data.begin(), data.end(), 0ull,
+			   [=](uint64_t a, const InputData& d){
+			       if (is_valid_data(d)
+				   || (concat && is_valid_data(d, true)))
 				   return a + d.result;
 			       else {
 				   return a;
 			       }
 			   });
-    return ans(acc);
 }
 
-Answer part_2(const std::string& input)
+Answer part_1(const std::string& input)
 {
-    std::vector<InputData> data = read_input_data(input);
-    uint64_t acc = std::accumulate(data.begin(), data.end(), 0ull,
-			   [](uint64_t a, const InputData& d){
-			       if (is_valid_data(d)
-				   || is_valid_data(d, true))
-				   return a + d.result;
-			       else {
-				   return a;
-			       }
-			   });
-    return ans(acc);
+    return ans(total_calibration(input, false));
 }
 
-void tests()
+Answer part_2(const std::string& input)
 {
-    const char * test_input_1 =
-	"190: 10 19\n"
-	"3267: 81 40 27\n"
-	"83: 17 5\n"
-	"156: 15 6\n"
-	"7290: 6 8 6 15\n"
-	"161011: 16 10 13\n"
-	"192: 17 8 14\n"
-	"21037: 9 7 18 13\n"
-	"292: 11 6 16 20\n";
+    return ans(total_calibration(input, true));
+}
 
+constexpr const char * test_input_1 =
+    "190: 10 19\n"
+    "3267: 81 40 27\n"
+    "83: 17 5\n"
+    "156: 15 6\n"
+    "7290: 6 8 6 15\n"
+    "161011: 16 10 13\n"
+    "192: 17 8 14\n"
+    "21037: 9 7 18 13\n"
+    "292: 11 6 16 20\n";
+
+constexpr bool static_tests()
+{
     std::vector<InputData> data = read_input_data(test_input_1);
     CHECK(data.size() == 9);
     CHECK(data[0].result == 190);
@@ -234,8 +234,6 @@ void tests()
     CHECK(!is_valid_data(data[7]));
     CHECK(is_valid_data(data[8]));
 
-    // checker_part1();
-    
     // Found by checker
     InputData my_data = {
 	58,
@@ -245,15 +243,29 @@ void tests()
     CHECK(produced_by(my_data, my_ops));
     CHECK(is_valid_data(my_data));
 
-    CHECK(part_1(test_input_1) == 3749);
+    CHECK(total_calibration(test_input_1, false) == 3749);
 
     /////////////////////////////////////////
 
     CHECK(produced_by(data[3], {Concat}));
     CHECK(produced_by(data[4], {Mul, Concat, Mul}));
     CHECK(produced_by(data[6], {Concat, Add}));
+    CHECK(concatenate(12, 345) == 12345);
+    CHECK(concatenate(1, 0) == 10);
+    CHECK(concatenate(10, 10) == 1010);
+    CHECK(total_calibration(test_input_1, true) == 11387);
+
+    return true;
+}
+
+static_assert(static_tests());
+
+void tests()
+{
+    // checker_part1();
+
+    CHECK(part_1(test_input_1) == 3749);
     CHECK(part_2(test_input_1) == 11387);
-   
 }
 
 } //namespace day7
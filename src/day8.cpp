@@ -18,11 +18,8 @@ InputData read_input_data(const std::string& input)
     InputData data;
     data.bounds = std::make_pair(lines.size(), lines[0].size());
 
-    for (size_t i = 0; i < lines.size(); i++) {
-	for (size_t j = 0; j < lines[i].size(); j++) {
-	    if (lines[i][j] != '.' && lines[i][j] != '#')
-		data.map.insert({{i, j}, lines[i][j]});
-	}
+    for (auto [i, j] : find_cells(input, ".#", true)) {
+	data.map.insert({{i, j}, lines[i][j]});
     }
     return data;
 }
@@ -0,0 +1,15 @@
+#pragma once
+#include "common.hpp"
+DAY(8);
+DAY(9);
+DAY(12);
+DAY(5);
+DAY(4);
+DAY(6);
+DAY(7);
+DAY(10);
+DAY(11);
+DAY(3);
+DAY(13);
+DAY(1);
+DAY(2);
@@ -3,6 +3,39 @@
 
 #include "common.hpp"
 #include "days.hpp"
+#include "perf.hpp"
+
+template <int N>
+void bench_day(PerfResults& results, const PerfConfig& config)
+{
+    Day<N> day;
+    std::string input;
+    try {
+	input = day.load_input();
+    } catch (std::runtime_error& e) {
+	// perf-check reports the baseline entries this leaves out
+	std::cerr << "Day " << N << ": " << e.what() << ", skipped" << std::endl;
+	return;
+    }
+    std::optional<std::string> scaled = scale_input(N, input, config.scale);
+
+    for (int part : {1, 2}) {
+	std::cerr << "Day " << N << ", Part " << part << " // timing";
+	std::optional<int> cpu = current_cpu();
+	if (!pinned_cpus().empty() && cpu)
+	    std::cerr << " on cpu " << *cpu;
+	std::cerr << std::endl;
+	std::string key = std::to_string(N) + "." + std::to_string(part);
+	try {
+	    results[key] = day.time_part(input, part, config.reps);
+	    if (scaled) {
+		results[key + ".x" + std::to_string(config.scale)] =
+		    day.time_part(*scaled, part, config.reps);
+	    }
+	} catch(NotImplemented&) {
+	}
+    }
+}
 
 template <int N,
 	  typename T = std::conditional_t<Day<N>::value, Day<N>, void>,
@@ -21,6 +54,9 @@ struct RunnerImpl<N, Day<N>, void> {
     bool match(int n) {
 	return n == N;
     }
+    void bench(PerfResults& results, const PerfConfig& config) {
+	bench_day<N>(results, config);
+    }
 };
 
 template <int N>
@@ -36,6 +72,10 @@ struct RunnerImpl<N, Day<N>, Day<N+1>> {
     bool match(int n) {
 	return (n == N) || Next().match(n);
     }
+    void bench(PerfResults& results, const PerfConfig& config) {
+	bench_day<N>(results, config);
+	Next().bench(results, config);
+    }
 };
 
 template <int N>
@@ -73,8 +113,43 @@ get_args(int argc, char *argv[])
     throw std::runtime_error("Usage: " + std::string(argv[0]) + " [DAY] [PART]");
 }
 
+int perf_main(int argc, char *argv[])
+{
+    PerfConfig config = get_perf_config(argc, argv);
+    bool record = std::string(argv[1]) == "perf-record";
+
+    // Read first, so that a bad baseline fails before the timings
+    PerfResults baseline;
+    if (!record) {
+	baseline = read_baseline(config.baseline);
+	if (baseline.empty()) {
+	    std::cout << config.baseline << " is empty, record one with `make perf-baseline`"
+		      << std::endl;
+	    return EXIT_FAILURE;
+	}
+    }
+
+    PerfResults results;
+    Runner().bench(results, config);
+
+    if (record) {
+	write_baseline(config.baseline, results);
+	std::cout << "Wrote " << results.size() << " entries to "
+		  << config.baseline << std::endl;
+	return EXIT_SUCCESS;
+    }
+    return perf_check(results, baseline, config);
+}
+
 int main(int argc, char *argv[])
 {
+    pin_thread(0);
+
+    if (argc >= 2 && (std::string(argv[1]) == "perf-check" ||
+		      std::string(argv[1]) == "perf-record")) {
+	return perf_main(argc, argv);
+    }
+
     std::pair<std::optional<int>,
 	      std::optional<int>> args = get_args(argc, argv);
 
@@ -0,0 +1,279 @@
+#include <cmath>
+#include <iomanip>
+
+#include "perf.hpp"
+
+PerfConfig get_perf_config(int argc, char *argv[])
+{
+    // aoc2024 perf-check|perf-record [BASELINE [REPS [SCALE [THRESHOLD [ALPHA]]]]]
+    PerfConfig config;
+    if (argc > 2)
+	config.baseline = argv[2];
+    if (argc > 3)
+	config.reps = std::stoul(argv[3]);
+    if (argc > 4)
+	config.scale = std::stoul(argv[4]);
+    if (argc > 5)
+	config.threshold = std::stod(argv[5]);
+    if (argc > 6)
+	config.alpha = std::stod(argv[6]);
+    if (argc > 7)
+	throw std::runtime_error("Usage: " + std::string(argv[0])
+				 + " perf-check|perf-record"
+				 + " [BASELINE [REPS [SCALE [THRESHOLD [ALPHA]]]]]");
+    CHECK(config.reps >= 2);
+    CHECK(config.scale >= 1);
+    return config;
+}
+
+std::string repeat(const std::string& str, size_t factor, const std::string& sep = "")
+{
+    std::string out;
+    out.reserve((str.size() + sep.size()) * factor);
+    for (size_t k = 0; k < factor; k++) {
+	if (k > 0)
+	    out += sep;
+	out += str;
+    }
+    return out;
+}
+
+// So that the last line of a copy doesn't run into the next one
+std::string ending_in_newline(std::string str)
+{
+    if (!str.empty() && str.back() != '\n')
+	str += '\n';
+    return str;
+}
+
+std::optional<std::string> scale_input(int day, const std::string& input, size_t factor)
+{
+    switch (day) {
+    case 1:  // Lists of lines
+    case 2:
+    case 3:
+    case 7:
+    case 4:  // Grids that can be stacked vertically
+    case 12:
+	return repeat(ending_in_newline(input), factor);
+    case 5: {
+	// Rules once, then the updates over and over
+	size_t sep = input.find("\n\n");
+	CHECK(sep != std::string::npos);
+	return input.substr(0, sep + 2) + repeat(ending_in_newline(input.substr(sep + 2)), factor);
+    }
+    case 11: {
+	// A single line of stones
+	std::vector<std::string> lines = split_lines(input);
+	CHECK(lines.size() == 1);
+	return repeat(lines.front(), factor, " ") + "\n";
+    }
+    case 13:  // Blocks separated by empty lines
+	return repeat(ending_in_newline(input), factor, "\n");
+    default:
+	return {};
+    }
+}
+
+double median(std::vector<double> xs)
+{
+    CHECK(!xs.empty());
+    size_t half = xs.size() / 2;
+    std::nth_element(xs.begin(), xs.begin() + static_cast<int64_t>(half), xs.end());
+    if (xs.size() % 2 == 1)
+	return xs[half];
+    double hi = xs[half];
+    double lo = *std::max_element(xs.begin(), xs.begin() + static_cast<int64_t>(half));
+    return (lo + hi) / 2;
+}
+
+double mann_whitney_p(const std::vector<double>& xs, const std::vector<double>& ys)
+{
+    CHECK(!xs.empty() && !ys.empty());
+
+    double u = 0;
+    for (double x : xs) {
+	for (double y : ys) {
+	    if (x > y)
+		u += 1;
+	    else if (x == y)
+		u += 0.5;
+	}
+    }
+
+    // Normal approximation, with continuity correction
+    double n1 = static_cast<double>(xs.size());
+    double n2 = static_cast<double>(ys.size());
+    double mean = n1 * n2 / 2;
+    double sd = std::sqrt(n1 * n2 * (n1 + n2 + 1) / 12);
+    double z = (u - mean - 0.5) / sd;
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+void write_baseline(const std::string& path, const PerfResults& results)
+{
+    std::ofstream ofile(path);
+    if (!ofile) {
+	throw std::runtime_error("Unable to open " + path);
+    }
+
+    ofile << std::setprecision(9) << "{";
+    bool first = true;
+    for (const auto& [key, samples] : results) {
+	ofile << (first ? "\n" : ",\n");
+	first = false;
+	ofile << "  \"" << key << "\": {\"median\": " << median(samples)
+	      << ", \"samples\": [";
+	for (size_t i = 0; i < samples.size(); i++) {
+	    ofile << (i > 0 ? ", " : "") << samples[i];
+	}
+	ofile << "]}";
+    }
+    ofile << "\n}\n";
+}
+
+// Just enough JSON for the files written by write_baseline
+class BaselineReader {
+public:
+    explicit BaselineReader(const std::string& str) : m_str{str} {}
+
+    PerfResults read() {
+	PerfResults results;
+	expect('{');
+	if (peek() == '}') {
+	    m_pos++;
+	    return results;
+	}
+	do {
+	    std::string key = string();
+	    expect(':');
+	    results[key] = entry();
+	} while (next_in_list('}'));
+	return results;
+    }
+
+private:
+    char peek() {
+	while (m_pos < m_str.size() && std::isspace(static_cast<unsigned char>(m_str[m_pos])))
+	    m_pos++;
+	CHECK(m_pos < m_str.size());
+	return m_str[m_pos];
+    }
+
+    void expect(char c) {
+	CHECK(peek() == c);
+	m_pos++;
+    }
+
+    bool next_in_list(char close) {
+	char c = peek();
+	m_pos++;
+	CHECK(c == ',' || c == close);
+	return c == ',';
+    }
+
+    std::string string() {
+	expect('"');
+	size_t end = m_str.find('"', m_pos);
+	CHECK(end != std::string::npos);
+	std::string str = m_str.substr(m_pos, end - m_pos);
+	m_pos = end + 1;
+	return str;
+    }
+
+    double number() {
+	peek();
+	size_t len = 0;
+	double x = std::stod(m_str.substr(m_pos, 32), &len);
+	m_pos += len;
+	return x;
+    }
+
+    std::vector<double> samples() {
+	std::vector<double> xs;
+	expect('[');
+	if (peek() == ']') {
+	    m_pos++;
+	    return xs;
+	}
+	do {
+	    xs.push_back(number());
+	} while (next_in_list(']'));
+	return xs;
+    }
+
+    std::vector<double> entry() {
+	// The median is recomputed from the samples
+	std::vector<double> xs;
+	expect('{');
+	do {
+	    std::string field = string();
+	    expect(':');
+	    if (field == "samples")
+		xs = samples();
+	    else if (field == "median")
+		number();
+	    else
+		throw std::runtime_error("Unknown baseline field: " + field);
+	} while (next_in_list('}'));
+	CHECK(!xs.empty());
+	return xs;
+    }
+
+    const std::string& m_str;
+    size_t m_pos{0};
+};
+
+PerfResults read_baseline(const std::string& path)
+{
+    std::ifstream ifile(path);
+    if (!ifile) {
+	throw std::runtime_error("Unable to open " + path);
+    }
+    std::stringstream buffer;
+    buffer << ifile.rdbuf();
+    return BaselineReader(buffer.str()).read();
+}
+
+int perf_check(const PerfResults& results, const PerfResults& baseline, const PerfConfig& config)
+{
+    int status = EXIT_SUCCESS;
+    std::cout << std::fixed << std::setprecision(6);
+    for (const auto& [key, samples] : results) {
+	std::cout << std::setw(12) << std::left << key << std::right
+		  << " median " << median(samples) << "s";
+
+	auto it = baseline.find(key);
+	if (it == baseline.end()) {
+	    std::cout << "  (no baseline)" << std::endl;
+	    continue;
+	}
+
+	// Regression if slower than the baseline plus the threshold
+	std::vector<double> limit = it->second;
+	for (double& x : limit)
+	    x *= 1 + config.threshold;
+	double p = mann_whitney_p(samples, limit);
+	double ratio = median(samples) / median(it->second);
+
+	std::cout << "  baseline " << median(it->second) << "s"
+		  << "  ratio " << std::setprecision(3) << ratio
+		  << "  p " << p << std::setprecision(6);
+	if (p < config.alpha) {
+	    std::cout << "  REGRESSION" << std::endl;
+	    status = EXIT_FAILURE;
+	} else {
+	    std::cout << "  ok" << std::endl;
+	}
+    }
+
+    // A missing input, a day that stopped running or a renamed key
+    for (const auto& [key, samples] : baseline) {
+	if (!results.contains(key)) {
+	    std::cout << std::setw(12) << std::left << key << std::right
+		      << " baseline " << median(samples) << "s  MISSING" << std::endl;
+	    status = EXIT_FAILURE;
+	}
+    }
+    return status;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <map>
+
+#include "common.hpp"
+
+/////////////////////////////////////
+// Performance regression checks
+//
+// `aoc2024 perf-record` times every day over its real input and a
+// scaled up copy of it and stores the samples in a baseline file;
+// `aoc2024 perf-check` times them again and fails if any of them got
+// slower than the baseline by more than a threshold, according to a
+// one-sided Mann-Whitney U test.
+
+struct PerfConfig {
+    std::string baseline{"perf/baseline.json"};
+    size_t reps{15};
+    size_t scale{10};
+    double threshold{0.10};
+    double alpha{0.01};
+};
+
+// Seconds per run, keyed by "DAY.PART" for the real input and
+// "DAY.PART.xSCALE" for the scaled one
+using PerfResults = std::map<std::string, std::vector<double>>;
+
+PerfConfig get_perf_config(int argc, char *argv[]);
+
+// A valid input for the given day about `factor` times bigger than
+// `input`, if the format allows it
+std::optional<std::string> scale_input(int day, const std::string& input, size_t factor);
+
+double median(std::vector<double> xs);
+
+// One-sided p-value of a Mann-Whitney U test for xs being stochastically
+// greater than ys
+double mann_whitney_p(const std::vector<double>& xs, const std::vector<double>& ys);
+
+void write_baseline(const std::string& path, const PerfResults& results);
+PerfResults read_baseline(const std::string& path);
+
+// Prints the comparison and returns EXIT_FAILURE on regressions and on
+// baseline entries without a result
+int perf_check(const PerfResults& results, const PerfResults& baseline, const PerfConfig& config);